@@ -9,6 +9,7 @@
 #include "stm32f4xx_hal_flash.h"
 #include "rtos.h"
 #include "Thread.h"
+#include <malloc.h>
 
 // Firmware version
 #define FIRMWARE_VERSION "1.0.0"
@@ -16,16 +17,421 @@
 // Web server
 WiFiServer webServer(80);
 
-// Thread for web server
+// Thread for web server (accepts connections and services long-lived streams)
 rtos::Thread *webServerThread_ptr = NULL;
 
-// Flash storage for configuration (using STM32 internal flash)
-#define CONFIG_FLASH_SECTOR     FLASH_SECTOR_10    // Use sector 10 for config (128KB sector)
-#define CONFIG_FLASH_ADDRESS    0x080C0000         // Start of sector 10
+// HTTP worker pool - requests are handled by a fixed set of worker threads fed by a bounded queue
+#define HTTP_WORKER_COUNT       3
+#define HTTP_QUEUE_DEPTH        4                                     // Accepted connections waiting for a worker
+#define HTTP_QUEUE_SLOTS        (HTTP_QUEUE_DEPTH + HTTP_WORKER_COUNT)
+#define HTTP_WORKER_STACK_SIZE  4096                                  // Pages stream through a 512-byte PageWriter
+#define HTTP_FIRST_BYTE_TIMEOUT 2000                                  // Max wait for the request line
+#define HTTP_CONN_DEADLINE      5000                                  // Accept-to-close budget per connection
 
-// Configuration structure (stored in Flash memory)
+struct HttpConn {
+  WiFiClient client;
+  unsigned long acceptedAt;
+  unsigned long deadline;
+};
+
+struct HttpStats {
+  volatile uint32_t accepted;
+  volatile uint32_t served;
+  volatile uint32_t shed;          // Rejected with 503 because every slot was in use
+  volatile uint32_t expired;       // Deadline passed while waiting in the queue
+  volatile uint32_t queueDepthMax;
+  volatile uint32_t queueWaitTotal;
+  volatile uint32_t latencyTotal;  // Accept-to-close, milliseconds
+  volatile uint32_t latencyMax;
+  volatile uint32_t latencyLast;
+};
+
+HttpConn httpConns[HTTP_QUEUE_SLOTS];
+rtos::Queue<HttpConn, HTTP_QUEUE_SLOTS> httpFreeQueue;
+rtos::Queue<HttpConn, HTTP_QUEUE_SLOTS> httpPendingQueue;
+rtos::Thread *httpWorkerThreads[HTTP_WORKER_COUNT];
+volatile uint32_t httpQueueDepth = 0;
+volatile uint32_t httpBusyWorkers = 0;
+HttpStats httpStats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+rtos::Mutex streamMutex;   // Guards the SSE/IMU stream state shared by workers and the acceptor
+rtos::Mutex controlMutex;  // Serialises handlers that change device state (LEDs, display, config)
+
+// Firmware metrics - plain counters and fixed-bucket histograms, rendered by /metrics in
+// Prometheus text format. Everything is statically allocated; scrapes never allocate.
+#define METRIC_BUCKETS 8
+
+struct Histogram {
+  const uint32_t *bounds;                      // METRIC_BUCKETS ascending upper bounds, in units
+  uint32_t unitsPerSecond;                     // 1000 for milliseconds, 1000000 for microseconds
+  volatile uint32_t buckets[METRIC_BUCKETS + 1];  // Per-bucket counts (last is +Inf); cumulated when rendered
+  volatile uint32_t count;
+  volatile uint32_t sum;
+};
+
+const uint32_t latencyBoundsMs[METRIC_BUCKETS] = {5, 10, 25, 50, 100, 250, 500, 1000};
+const uint32_t serviceBoundsMs[METRIC_BUCKETS] = {10, 25, 50, 100, 250, 500, 1000, 5000};
+const uint32_t loopBoundsMs[METRIC_BUCKETS]    = {1, 5, 10, 25, 100, 500, 2000, 10000};
+const uint32_t sensorBoundsUs[METRIC_BUCKETS]  = {250, 500, 1000, 2000, 5000, 10000, 25000, 100000};
+
+#define HISTOGRAM(bounds, unitsPerSecond) {bounds, unitsPerSecond, {0}, 0, 0}
+
+enum SensorId { SENSOR_HTS221, SENSOR_LPS22HB, SENSOR_LSM6DSL, SENSOR_LIS2MDL, SENSOR_COUNT };
+const char *const sensorNames[SENSOR_COUNT] = {"hts221", "lps22hb", "lsm6dsl", "lis2mdl"};
+
+struct Metrics {
+  volatile uint32_t mqttConnects;
+  volatile uint32_t mqttConnectFailures;
+  volatile uint32_t mqttPublishes;
+  volatile uint32_t mqttPublishFailures;
+  volatile uint32_t mqttBytesWritten;
+  volatile uint32_t wifiReconnects;
+  volatile uint32_t wifiReconnectFailures;
+  volatile uint32_t watchdogNearMisses;  // Connectivity came back after more than half the watchdog timeout
+  volatile uint32_t httpUnmatched;       // Requests for paths not in the route table
+  volatile uint32_t syslogDatagrams;     // Remote log datagrams sent
+  volatile uint32_t syslogDropped;       // Log lines not shipped because of the rate limit
+  Histogram mqttPublishTime;
+  Histogram httpServiceTime;
+  Histogram loopTime;
+  Histogram sensorReadTime[SENSOR_COUNT];
+};
+
+Metrics metrics = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  HISTOGRAM(latencyBoundsMs, 1000),
+  HISTOGRAM(serviceBoundsMs, 1000),
+  HISTOGRAM(loopBoundsMs, 1000),
+  {HISTOGRAM(sensorBoundsUs, 1000000), HISTOGRAM(sensorBoundsUs, 1000000),
+   HISTOGRAM(sensorBoundsUs, 1000000), HISTOGRAM(sensorBoundsUs, 1000000)}
+};
+
+// Safe from any thread: each field is bumped atomically, a scrape may see one in-flight sample half-counted
+void histogramObserve(Histogram &h, uint32_t value) {
+  int i = 0;
+  while (i < METRIC_BUCKETS && value > h.bounds[i]) i++;
+  core_util_atomic_incr_u32(&h.buckets[i], 1);
+  core_util_atomic_incr_u32(&h.count, 1);
+  core_util_atomic_incr_u32(&h.sum, value);
+}
+
+// Profiling spans - cycle-accurate timing of hot paths using the Cortex-M4 DWT cycle counter.
+// Build with -DENABLE_PROFILING=1 (the az3166_profile environment); otherwise every PROFILE_*
+// macro expands to nothing. Spans must be shorter than one CYCCNT wrap (~42 s at 100 MHz).
+#ifndef ENABLE_PROFILING
+#define ENABLE_PROFILING 0
+#endif
+
+enum ProfileId {
+  PROF_CONNECT_MQTT,
+  PROF_PUBLISH_MQTT,
+  PROF_HTS221_TEMPERATURE,
+  PROF_HTS221_HUMIDITY,
+  PROF_LPS22HB_PRESSURE,
+  PROF_LSM6DSL_ACCEL,
+  PROF_LSM6DSL_GYRO,
+  PROF_LIS2MDL_MAG,
+  PROF_SCREEN_UPDATE,
+  PROF_PAGE_MAIN,
+  PROF_PAGE_CONTROL,
+  PROF_PAGE_TELEMETRY,
+  PROF_PAGE_SETUP,
+  PROF_PAGE_SUCCESS,
+  PROF_COUNT
+};
+
+#if ENABLE_PROFILING
+
+#define PROFILE_BUCKETS 7  // <10us, <100us, <1ms, <10ms, <100ms, <1s, >=1s
+
+struct ProfileSpan {
+  const char *name;
+  uint32_t count;
+  uint64_t totalCycles;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint32_t buckets[PROFILE_BUCKETS];
+};
+
+ProfileSpan profileSpans[PROF_COUNT] = {
+  {"connect_mqtt"}, {"publish_mqtt"},
+  {"hts221_temperature"}, {"hts221_humidity"}, {"lps22hb_pressure"},
+  {"lsm6dsl_accel"}, {"lsm6dsl_gyro"}, {"lis2mdl_mag"},
+  {"screen_update"},
+  {"page_main"}, {"page_control"}, {"page_telemetry"}, {"page_setup"}, {"page_success"}
+};
+static_assert(sizeof(profileSpans) / sizeof(profileSpans[0]) == PROF_COUNT, "profileSpans must name every ProfileId");
+
+void profileInit() {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  for (int i = 0; i < PROF_COUNT; i++) {
+    profileSpans[i].minCycles = 0xFFFFFFFF;
+  }
+}
+
+void profileRecord(int id, uint32_t startCycles) {
+  uint32_t cycles = DWT->CYCCNT - startCycles;  // Unsigned subtraction handles one wrap
+  uint32_t us = cycles / (SystemCoreClock / 1000000);
+  int bucket = 0;
+  for (uint32_t limit = 10; bucket < PROFILE_BUCKETS - 1 && us >= limit; limit *= 10) bucket++;
+  
+  // Spans finish on several threads (pages on HTTP workers, sensors on loop); the update is a few dozen cycles
+  core_util_critical_section_enter();
+  ProfileSpan &span = profileSpans[id];
+  span.count++;
+  span.totalCycles += cycles;
+  if (cycles < span.minCycles) span.minCycles = cycles;
+  if (cycles > span.maxCycles) span.maxCycles = cycles;
+  span.buckets[bucket]++;
+  core_util_critical_section_exit();
+}
+
+void profileReset() {
+  core_util_critical_section_enter();
+  for (int i = 0; i < PROF_COUNT; i++) {
+    const char *name = profileSpans[i].name;
+    memset(&profileSpans[i], 0, sizeof(ProfileSpan));
+    profileSpans[i].name = name;
+    profileSpans[i].minCycles = 0xFFFFFFFF;
+  }
+  core_util_critical_section_exit();
+}
+
+// Records the enclosing scope when it ends
+struct ProfileScope {
+  int id;
+  uint32_t start;
+  ProfileScope(int i) : id(i), start(DWT->CYCCNT) {}
+  ~ProfileScope() { profileRecord(id, start); }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SPAN(id)  ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(id)
+#define PROFILE_START(id) uint32_t profileStart_##id = DWT->CYCCNT
+#define PROFILE_STOP(id)  profileRecord(id, profileStart_##id)
+
+// One report line per span, times in microseconds:
+// name count total_us min_us avg_us max_us | <10us <100us <1ms <10ms <100ms <1s >=1s
+int formatProfileRow(char *out, int outSize, int id) {
+  core_util_critical_section_enter();
+  ProfileSpan span = profileSpans[id];
+  core_util_critical_section_exit();
+  
+  uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+  unsigned long totalUs = (unsigned long)(span.totalCycles / cyclesPerUs);
+  int pos = snprintf(out, outSize, "%-20s %7lu %11lu %8lu %8lu %8lu |",
+    span.name, (unsigned long)span.count, totalUs,
+    span.count ? (unsigned long)(span.minCycles / cyclesPerUs) : 0UL,
+    span.count ? totalUs / span.count : 0UL,
+    (unsigned long)(span.maxCycles / cyclesPerUs));
+  for (int i = 0; i < PROFILE_BUCKETS && pos < outSize; i++) {
+    pos += snprintf(out + pos, outSize - pos, " %lu", (unsigned long)span.buckets[i]);
+  }
+  if (pos < outSize) pos += snprintf(out + pos, outSize - pos, "\n");
+  return pos < outSize ? pos : outSize - 1;
+}
+
+const char PROFILE_REPORT_HEADER[] =
+  "span                   count    total_us   min_us   avg_us   max_us | <10us <100us <1ms <10ms <100ms <1s >=1s\n";
+
+// Serial command: "profile" prints the table, "profile reset" clears it
+void printProfileReport() {
+  char line[128];
+  Serial.print(PROFILE_REPORT_HEADER);
+  for (int i = 0; i < PROF_COUNT; i++) {
+    formatProfileRow(line, sizeof(line), i);
+    Serial.print(line);
+  }
+}
+
+void serviceSerialCommands() {
+  static char command[24];
+  static int len = 0;
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      command[len] = '\0';
+      if (strcmp(command, "profile") == 0) {
+        printProfileReport();
+      } else if (strcmp(command, "profile reset") == 0) {
+        profileReset();
+        Serial.println("Profile counters cleared");
+      }
+      len = 0;
+    } else if (len < (int)sizeof(command) - 1) {
+      command[len++] = c;
+    }
+  }
+}
+
+#else
+
+#define PROFILE_SPAN(id)
+#define PROFILE_START(id)
+#define PROFILE_STOP(id)
+
+#endif
+
+// Logging - LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG format into a lock-free ring of fixed slots
+// and return; a low-priority thread drains the ring to Serial. Calls above LOG_LEVEL compile
+// away entirely. When the ring is full the message is dropped and counted, never waited for.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_SLOT_COUNT        32   // Power of two
+#define LOG_SLOT_SIZE         96   // Longer messages are truncated
+#define LOG_DRAIN_INTERVAL    20   // Drain thread poll period when the ring is empty (ms)
+#define LOG_THREAD_STACK_SIZE 2048  // Room for the remote sink's snprintf
+
+// Bounded MPSC queue (Vyukov): a slot's sequence says whose turn it is.
+// seq == pos      -> free for the producer claiming position pos
+// seq == pos + 1  -> filled, ready for the consumer at pos
+struct LogSlot {
+  volatile uint32_t seq;
+  uint8_t level;
+  char text[LOG_SLOT_SIZE];
+};
+
+LogSlot logSlots[LOG_SLOT_COUNT];
+volatile uint32_t logEnqueuePos = 0;
+volatile uint32_t logDequeuePos = 0;   // Advanced by the drain thread only
+volatile uint32_t logDropped = 0;
+rtos::Thread *logThread_ptr = NULL;
+
+// Optional second destination, called on the drain thread for every message
+// and with text == NULL when the ring is idle (so batching sinks can flush)
+typedef void (*LogSink)(uint8_t level, const char *text);
+LogSink logRemoteSink = NULL;
+
+void logInit() {
+  for (uint32_t i = 0; i < LOG_SLOT_COUNT; i++) {
+    logSlots[i].seq = i;
+  }
+}
+
+void logWrite(uint8_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void logWrite(uint8_t level, const char *fmt, ...) {
+  uint32_t pos = logEnqueuePos;
+  LogSlot *slot;
+  for (;;) {
+    slot = &logSlots[pos & (LOG_SLOT_COUNT - 1)];
+    int32_t dif = (int32_t)(slot->seq - pos);
+    if (dif == 0) {
+      if (core_util_atomic_cas_u32(&logEnqueuePos, &pos, pos + 1)) break;  // pos reloaded on failure
+    } else if (dif < 0) {
+      core_util_atomic_incr_u32(&logDropped, 1);  // Ring full
+      return;
+    } else {
+      pos = logEnqueuePos;  // Another producer claimed this slot first
+    }
+  }
+  
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(slot->text, LOG_SLOT_SIZE, fmt, args);
+  va_end(args);
+  slot->level = level;
+  __DMB();
+  slot->seq = pos + 1;  // Publish to the drain thread
+}
+
+// Write out everything queued so far; returns the number of messages written
+int logDrain() {
+  static const char *const prefixes[] = {"", "E: ", "W: ", "", ""};
+  int written = 0;
+  for (;;) {
+    LogSlot *slot = &logSlots[logDequeuePos & (LOG_SLOT_COUNT - 1)];
+    if (slot->seq != logDequeuePos + 1) break;
+    __DMB();
+    Serial.print(prefixes[slot->level]);
+    Serial.println(slot->text);
+    if (logRemoteSink != NULL) {
+      logRemoteSink(slot->level, slot->text);
+    }
+    __DMB();
+    slot->seq = logDequeuePos + LOG_SLOT_COUNT;  // Hand the slot back for the next lap
+    logDequeuePos++;
+    written++;
+  }
+  
+  static uint32_t reportedDropped = 0;
+  uint32_t dropped = logDropped;
+  if (dropped != reportedDropped) {
+    Serial.print("W: log ring overflow, ");
+    Serial.print(dropped - reportedDropped);
+    Serial.println(" messages dropped");
+    reportedDropped = dropped;
+  }
+  return written;
+}
+
+void logThreadFunc() {
+  while (true) {
+    if (logDrain() == 0) {
+      if (logRemoteSink != NULL) {
+        logRemoteSink(0, NULL);
+      }
+      Thread::wait(LOG_DRAIN_INTERVAL);
+    }
+  }
+}
+
+// Called before anything that resets the MCU so the last messages reach the console
+void logFlush() {
+  if (logThread_ptr == NULL) {
+    logDrain();
+    return;
+  }
+  for (int i = 0; i < 100 && logDequeuePos != logEnqueuePos; i++) {
+    Thread::wait(10);
+  }
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...)  logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...)  do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...)  logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...)  do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+// "0x10 0x1A ..." for packet dumps at debug level
+const char *formatHex(char *out, int outSize, const uint8_t *data, int len) {
+  int pos = 0;
+  out[0] = '\0';
+  for (int i = 0; i < len && pos + 5 < outSize; i++) {
+    pos += snprintf(out + pos, outSize - pos, "0x%02X ", data[i]);
+  }
+  return out;
+}
+
+// Configuration structure (stored in Flash memory as a CONFIG_RECORD_DEVICE record; the
+// magic/checksum fields are only meaningful in the pre-store layout read by loadLegacyConfig)
 struct DeviceConfig {
-  char magic[4];           // "AZ31" - magic bytes to verify valid config
+  char magic[4];           // "AZ32" - magic bytes to verify valid config ("AZ31" = layout without syslog)
   char deviceId[32];       // Device name/ID
   char model[16];          // Device model (e.g., "az3166")
   char location[32];       // Device location (e.g., "Garage")
@@ -34,13 +440,19 @@ struct DeviceConfig {
   char mqttServer[64];    // MQTT server hostname
   int mqttPort;           // MQTT port
   char mqttTopic[64];     // MQTT topic
-  uint8_t checksum;       // Simple checksum
+  uint8_t checksum;       // 8-bit XOR (legacy layout only)
   uint8_t padding[3];     // Explicit padding to ensure word alignment
+  // Added in "AZ32" - appended so an "AZ31" record is a valid prefix
+  char syslogHost[16];    // Remote log collector IPv4 address, empty = disabled
+  int syslogPort;         // Remote log collector UDP port
 } __attribute__((packed));
 
+// Size of the original "AZ31" layout (everything before syslogHost)
+#define CONFIG_LEGACY_SIZE  offsetof(DeviceConfig, syslogHost)
+
 // Default configuration
 DeviceConfig config = {
-  {'A','Z','3','1'},      // magic
+  {'A','Z','3','2'},      // magic
   "SensorStation_01",     // deviceId
   "az3166",               // model
   "Garage",               // location
@@ -49,231 +461,673 @@ DeviceConfig config = {
   "mqtt.example.com",     // mqttServer
   1883,                   // mqttPort
   "sensors/az3166",       // mqttTopic
-  0,                      // checksum (calculated later)
-  {0, 0, 0}              // padding
+  0,                      // checksum (legacy layout only)
+  {0, 0, 0},             // padding
+  "",                     // syslogHost (disabled)
+  514                     // syslogPort
 };
 
-// Flash storage functions for persistent configuration
-// Note: This implementation uses STM32 HAL Flash functions for real persistence
-bool saveConfigToFlash() {
-  // Clear checksum and padding before calculating
-  config.checksum = 0;
-  memset(config.padding, 0, sizeof(config.padding));
-  
-  // Calculate checksum over specific fields manually to avoid struct padding issues
-  uint8_t calculatedChecksum = 0;
-  
-  // Hash magic bytes (4 bytes)
-  for (int i = 0; i < 4; i++) {
-    calculatedChecksum ^= config.magic[i];
-  }
-  
-  // Hash device ID (32 bytes)
-  for (int i = 0; i < 32; i++) {
-    calculatedChecksum ^= config.deviceId[i];
-  }
-  
-  // Hash model (16 bytes)
-  for (int i = 0; i < 16; i++) {
-    calculatedChecksum ^= config.model[i];
+// Config store - append-only record log across two flash sectors.
+// Each sector starts with a header {magic, sequence}; the valid sector with the highest
+// sequence is active. Records are appended after it:
+//   {magic, type, length, sequence, crc32}  payload  (padded to a word)
+// The CRC covers the header fields and the payload, so a record torn by a reset is skipped
+// and the previous one stays in effect. A save programs a few dozen words; only when the
+// active sector is full is the other one erased, given the latest record of every type,
+// and then stamped with a higher sequence - until that last write the old sector still wins.
+#define CONFIG_STORE_SECTOR_A    FLASH_SECTOR_10
+#define CONFIG_STORE_ADDRESS_A   0x080C0000
+#define CONFIG_STORE_SECTOR_B    FLASH_SECTOR_11
+#define CONFIG_STORE_ADDRESS_B   0x080E0000
+#define CONFIG_STORE_SECTOR_SIZE (128 * 1024)
+#define CONFIG_STORE_MAGIC       0x46435A41   // "AZCF"
+#define CONFIG_RECORD_MAGIC      0x43455241   // "AREC"
+#define CONFIG_ERASED_WORD       0xFFFFFFFF
+
+// Record types - append new ones, never renumber
+#define CONFIG_RECORD_DEVICE     1            // DeviceConfig
+#define CONFIG_RECORD_SETTINGS   2            // RuntimeSettings
+#define CONFIG_RECORD_TYPE_MAX   8
+
+struct ConfigStoreHeader {
+  uint32_t magic;
+  uint32_t sequence;
+};
+
+struct ConfigRecordHeader {
+  uint32_t magic;
+  uint16_t type;
+  uint16_t length;     // Payload bytes, before padding
+  uint32_t sequence;   // Store-wide, increases with every record written
+  uint32_t crc;        // CRC32 of the fields above and the payload
+};
+
+const uint32_t configStoreAddresses[2] = {CONFIG_STORE_ADDRESS_A, CONFIG_STORE_ADDRESS_B};
+const uint32_t configStoreSectors[2] = {CONFIG_STORE_SECTOR_A, CONFIG_STORE_SECTOR_B};
+
+// Located by configStoreScan()
+struct ConfigStoreState {
+  int active;                 // Sector index 0/1, -1 if neither is formatted
+  uint32_t sectorSequence;
+  uint32_t appendOffset;      // First free byte in the active sector
+  uint32_t nextSequence;
+  bool damaged;               // Unparsable bytes after the last good record - compact on next write
+  const ConfigRecordHeader *latest[CONFIG_RECORD_TYPE_MAX + 1];
+};
+
+ConfigStoreState configStore;
+
+// CRC-32 (IEEE 802.3), nibble table - small and plenty fast for a few hundred bytes
+uint32_t crc32Update(uint32_t crc, const void *data, uint32_t len) {
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  const uint8_t *p = (const uint8_t *)data;
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
   }
-  
-  // Hash location (32 bytes)
-  for (int i = 0; i < 32; i++) {
-    calculatedChecksum ^= config.location[i];
+  return ~crc;
+}
+
+uint32_t configRecordCrc(const ConfigRecordHeader *hdr, const void *payload) {
+  uint32_t crc = crc32Update(0, hdr, offsetof(ConfigRecordHeader, crc));
+  return crc32Update(crc, payload, hdr->length);
+}
+
+inline uint32_t configPadded(uint32_t len) {
+  return (len + 3) & ~3u;
+}
+
+// Walk one sector; fills configStore for it. Returns false if the sector isn't formatted.
+bool configStoreScanSector(int sector) {
+  uint32_t base = configStoreAddresses[sector];
+  const ConfigStoreHeader *sh = (const ConfigStoreHeader *)base;
+  if (sh->magic != CONFIG_STORE_MAGIC) return false;
+  
+  configStore.active = sector;
+  configStore.sectorSequence = sh->sequence;
+  configStore.damaged = false;
+  memset(configStore.latest, 0, sizeof(configStore.latest));
+  
+  uint32_t offset = sizeof(ConfigStoreHeader);
+  while (offset + sizeof(ConfigRecordHeader) <= CONFIG_STORE_SECTOR_SIZE) {
+    const ConfigRecordHeader *hdr = (const ConfigRecordHeader *)(base + offset);
+    if (hdr->magic == CONFIG_ERASED_WORD) break;  // End of log
+    uint32_t span = sizeof(ConfigRecordHeader) + configPadded(hdr->length);
+    if (hdr->magic != CONFIG_RECORD_MAGIC || offset + span > CONFIG_STORE_SECTOR_SIZE) {
+      configStore.damaged = true;  // Torn header; can't find the next record boundary
+      break;
+    }
+    if (configRecordCrc(hdr, hdr + 1) == hdr->crc) {
+      if (hdr->type <= CONFIG_RECORD_TYPE_MAX) configStore.latest[hdr->type] = hdr;
+      if (hdr->sequence >= configStore.nextSequence) configStore.nextSequence = hdr->sequence + 1;
+    }
+    offset += span;
   }
+  configStore.appendOffset = offset;
   
-  // Hash SSID (32 bytes)
-  for (int i = 0; i < 32; i++) {
-    calculatedChecksum ^= config.ssid[i];
+  // A write cut short before its header leaves programmed payload words past the end of
+  // the log; appending over them would fail, so check the tail is really blank (~0.3 ms)
+  for (uint32_t tail = offset; !configStore.damaged && tail < CONFIG_STORE_SECTOR_SIZE; tail += 4) {
+    if (*(const uint32_t *)(base + tail) != CONFIG_ERASED_WORD) configStore.damaged = true;
   }
-  
-  // Hash password (64 bytes)
-  for (int i = 0; i < 64; i++) {
-    calculatedChecksum ^= config.password[i];
+  return true;
+}
+
+void configStoreScan() {
+  const ConfigStoreHeader *a = (const ConfigStoreHeader *)CONFIG_STORE_ADDRESS_A;
+  const ConfigStoreHeader *b = (const ConfigStoreHeader *)CONFIG_STORE_ADDRESS_B;
+  bool aValid = a->magic == CONFIG_STORE_MAGIC;
+  bool bValid = b->magic == CONFIG_STORE_MAGIC;
+  
+  configStore.active = -1;
+  configStore.nextSequence = 1;
+  if (aValid && (!bValid || (int32_t)(a->sequence - b->sequence) > 0)) {
+    configStoreScanSector(0);
+  } else if (bValid) {
+    configStoreScanSector(1);
   }
-  
-  // Hash MQTT server (64 bytes)
-  for (int i = 0; i < 64; i++) {
-    calculatedChecksum ^= config.mqttServer[i];
+}
+
+bool configProgramWords(uint32_t address, const void *data, uint32_t len) {
+  const uint8_t *src = (const uint8_t *)data;
+  for (uint32_t i = 0; i < len; i += 4) {
+    uint32_t word = CONFIG_ERASED_WORD;
+    memcpy(&word, src + i, len - i < 4 ? len - i : 4);
+    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + i, word) != HAL_OK) {
+      LOG_ERROR("Flash program failed at 0x%08lx", (unsigned long)(address + i));
+      return false;
+    }
   }
-  
-  // Hash MQTT port (4 bytes)
-  uint8_t* portBytes = (uint8_t*)&config.mqttPort;
-  for (int i = 0; i < 4; i++) {
-    calculatedChecksum ^= portBytes[i];
+  return true;
+}
+
+// Program one record at base+offset; flash must already be unlocked
+bool configWriteRecord(uint32_t base, uint32_t offset, uint16_t type, uint32_t sequence,
+                       const void *payload, uint16_t length) {
+  ConfigRecordHeader hdr;
+  hdr.magic = CONFIG_RECORD_MAGIC;
+  hdr.type = type;
+  hdr.length = length;
+  hdr.sequence = sequence;
+  hdr.crc = configRecordCrc(&hdr, payload);
+  // Payload first, header last: an interrupted write leaves a blank or bad-CRC record
+  return configProgramWords(base + offset + sizeof(hdr), payload, length) &&
+         configProgramWords(base + offset, &hdr, sizeof(hdr));
+}
+
+// Move the live records into the other sector, then stamp it active
+bool configStoreCompact() {
+  int target = configStore.active == 1 ? 0 : 1;  // First format goes to sector 11, leaving a legacy config intact
+  uint32_t base = configStoreAddresses[target];
+  LOG_INFO("Config store: compacting into sector %d", target == 0 ? 10 : 11);
+  
+  FLASH_EraseInitTypeDef erase;
+  uint32_t sectorError = 0;
+  erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+  erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+  erase.Sector = configStoreSectors[target];
+  erase.NbSectors = 1;
+  if (HAL_FLASHEx_Erase(&erase, &sectorError) != HAL_OK) {
+    LOG_ERROR("Flash erase failed!");
+    return false;
   }
   
-  // Hash MQTT topic (64 bytes)
-  for (int i = 0; i < 64; i++) {
-    calculatedChecksum ^= config.mqttTopic[i];
+  uint32_t offset = sizeof(ConfigStoreHeader);
+  for (int type = 1; type <= CONFIG_RECORD_TYPE_MAX; type++) {
+    const ConfigRecordHeader *hdr = configStore.active >= 0 ? configStore.latest[type] : NULL;
+    if (hdr == NULL) continue;
+    if (!configWriteRecord(base, offset, type, hdr->sequence, hdr + 1, hdr->length)) return false;
+    offset += sizeof(ConfigRecordHeader) + configPadded(hdr->length);
   }
   
-  config.checksum = calculatedChecksum;
+  ConfigStoreHeader sh = {CONFIG_STORE_MAGIC, configStore.sectorSequence + 1};
+  if (!configProgramWords(base, &sh, sizeof(sh))) return false;
   
-  Serial.println("Saving configuration to Flash...");
-  Serial.print("Calculated checksum: 0x");
-  Serial.println(config.checksum, 16);
-  Serial.print("Config size: ");
-  Serial.println(sizeof(DeviceConfig));
+  configStoreScanSector(target);
+  return true;
+}
+
+// Append a record, compacting first if it doesn't fit (or the log tail is damaged)
+bool configStoreWrite(uint16_t type, const void *payload, uint16_t length) {
+  uint32_t span = sizeof(ConfigRecordHeader) + configPadded(length);
+  bool ok = true;
   
-  // Unlock the Flash memory
   HAL_FLASH_Unlock();
-  
-  // Erase the sector
-  FLASH_EraseInitTypeDef EraseInitStruct;
-  uint32_t SectorError = 0;
-  
-  EraseInitStruct.TypeErase = FLASH_TYPEERASE_SECTORS;
-  EraseInitStruct.VoltageRange = FLASH_VOLTAGE_RANGE_3;
-  EraseInitStruct.Sector = CONFIG_FLASH_SECTOR;
-  EraseInitStruct.NbSectors = 1;
-  
-  if (HAL_FLASHEx_Erase(&EraseInitStruct, &SectorError) != HAL_OK) {
-    Serial.println("Flash erase failed!");
-    HAL_FLASH_Lock();
-    return false;
+  if (configStore.active < 0 || configStore.damaged ||
+      configStore.appendOffset + span > CONFIG_STORE_SECTOR_SIZE) {
+    ok = configStoreCompact();
   }
-  
-  // Write the configuration data word by word
-  uint32_t* configData = (uint32_t*)&config;
-  uint32_t address = CONFIG_FLASH_ADDRESS;
-  int numWords = (sizeof(DeviceConfig) + 3) / 4;  // Round up to nearest word
-  
-  Serial.print("Writing ");
-  Serial.print(numWords);
-  Serial.println(" words to Flash...");
-  
-  for (int i = 0; i < numWords; i++) {
-    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address, configData[i]) != HAL_OK) {
-      Serial.print("Flash write failed at word ");
-      Serial.println(i);
-      HAL_FLASH_Lock();
-      return false;
+  if (ok) {
+    uint32_t base = configStoreAddresses[configStore.active];
+    ok = configWriteRecord(base, configStore.appendOffset, type, configStore.nextSequence, payload, length);
+    if (ok) {
+      configStore.latest[type] = (const ConfigRecordHeader *)(base + configStore.appendOffset);
+      configStore.appendOffset += span;
+      configStore.nextSequence++;
+    } else {
+      configStore.damaged = true;
     }
-    address += 4;
   }
-  
-  // Lock the Flash memory
   HAL_FLASH_Lock();
-  
-  Serial.println("Configuration saved successfully to Flash!");
-  return true;
+  return ok;
 }
 
-bool loadConfigFromFlash() {
-  Serial.println("Loading configuration from Flash...");
-  
-  // Read configuration from Flash
-  DeviceConfig* flashConfig = (DeviceConfig*)CONFIG_FLASH_ADDRESS;
-  
-  // Check magic bytes
-  Serial.print("Magic bytes from Flash: ");
-  for (int i = 0; i < 4; i++) {
-    Serial.print("0x");
-    Serial.print(flashConfig->magic[i], 16);
-    Serial.print(" ");
+// Latest valid payload of a type, or NULL
+const void *configStoreRead(uint16_t type, uint16_t *length) {
+  const ConfigRecordHeader *hdr = configStore.active >= 0 ? configStore.latest[type] : NULL;
+  if (hdr == NULL) return NULL;
+  *length = hdr->length;
+  return hdr + 1;
+}
+
+bool saveConfigToFlash() {
+  unsigned long start = millis();
+  if (!configStoreWrite(CONFIG_RECORD_DEVICE, &config, sizeof(DeviceConfig))) {
+    LOG_ERROR("Configuration save failed");
+    return false;
   }
-  Serial.println();
-  
-  if (flashConfig->magic[0] != 'A' || flashConfig->magic[1] != 'Z' || 
-      flashConfig->magic[2] != '3' || flashConfig->magic[3] != '1') {
-    Serial.println("No valid magic bytes found in Flash");
+  LOG_INFO("Configuration saved to Flash (record %lu, %lu bytes free, %lu ms)",
+           (unsigned long)(configStore.nextSequence - 1),
+           (unsigned long)(CONFIG_STORE_SECTOR_SIZE - configStore.appendOffset),
+           millis() - start);
+  return true;
+}
+
+// Pre-store firmware wrote a bare DeviceConfig at the start of sector 10 with an 8-bit XOR
+// over every byte except the checksum. Only used once, to migrate.
+bool loadLegacyConfig() {
+  const DeviceConfig *flashConfig = (const DeviceConfig *)CONFIG_STORE_ADDRESS_A;
+  if (flashConfig->magic[0] != 'A' || flashConfig->magic[1] != 'Z' || flashConfig->magic[2] != '3' ||
+      (flashConfig->magic[3] != '1' && flashConfig->magic[3] != '2')) {
     return false;
   }
-  
-  // Calculate checksum using the same field-by-field method as save
-  uint8_t calculatedChecksum = 0;
-  
-  // Hash magic bytes (4 bytes)
-  for (int i = 0; i < 4; i++) {
-    calculatedChecksum ^= flashConfig->magic[i];
+  uint32_t size = flashConfig->magic[3] == '1' ? CONFIG_LEGACY_SIZE : sizeof(DeviceConfig);
+  const uint8_t *data = (const uint8_t *)flashConfig;
+  uint8_t checksum = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    if (i != offsetof(DeviceConfig, checksum)) checksum ^= data[i];
   }
-  
-  // Hash device ID (32 bytes)
-  for (int i = 0; i < 32; i++) {
-    calculatedChecksum ^= flashConfig->deviceId[i];
+  if (checksum != flashConfig->checksum) {
+    LOG_WARN("Legacy configuration checksum mismatch");
+    return false;
   }
+  memcpy(&config, flashConfig, size);
+  config.magic[3] = '2';
+  LOG_INFO("Migrated legacy configuration; it moves into the config store on the next save");
+  return true;
+}
+
+bool loadConfigFromFlash() {
+  configStoreScan();
   
-  // Hash model (16 bytes)
-  for (int i = 0; i < 16; i++) {
-    calculatedChecksum ^= flashConfig->model[i];
+  uint16_t length;
+  const void *payload = configStoreRead(CONFIG_RECORD_DEVICE, &length);
+  if (payload == NULL) {
+    LOG_INFO("No configuration record in the config store");
+    return configStore.active < 0 && loadLegacyConfig();
   }
-  
-  // Hash location (32 bytes)
-  for (int i = 0; i < 32; i++) {
-    calculatedChecksum ^= flashConfig->location[i];
+  // Older, shorter layouts are a prefix of the current one; fields they lack keep their defaults
+  memcpy(&config, payload, length < sizeof(DeviceConfig) ? length : sizeof(DeviceConfig));
+  LOG_INFO("Configuration loaded from config store (sector %d, record %lu)",
+           configStore.active == 0 ? 10 : 11, (unsigned long)(configStore.nextSequence - 1));
+  return true;
+}
+
+// Sensor history - circular time-series log in flash sectors 8 and 9 (256 KB).
+// The area is split into 2 KB pages; each page has a header with a sequence number and the
+// time of its first record (the time index), followed by fixed-size 12-byte records.
+// Records are appended in place; when the head reaches a new sector that sector - holding
+// the oldest pages - is erased first. Readers walk the memory-mapped flash directly.
+//
+// There is no wall clock, so times are "history seconds": a counter that resumes at boot
+// just after the newest stored record. Downtime is therefore not visible in the timeline;
+// /api/history/info reports the current history time so clients can map it to wall time.
+#define HISTORY_BASE_ADDRESS   0x08080000
+#define HISTORY_SECTOR_FIRST   FLASH_SECTOR_8
+#define HISTORY_SECTOR_SIZE    (128 * 1024)
+#define HISTORY_SECTOR_COUNT   2
+#define HISTORY_PAGE_SIZE      2048
+#define HISTORY_PAGES_PER_SECTOR (HISTORY_SECTOR_SIZE / HISTORY_PAGE_SIZE)
+#define HISTORY_PAGE_COUNT     (HISTORY_PAGES_PER_SECTOR * HISTORY_SECTOR_COUNT)
+#define HISTORY_PAGE_MAGIC     0x53485A41   // "AZHS"
+#define HISTORY_SAMPLE_INTERVAL 30          // Gap assumed after the last record at boot (default sample_interval)
+
+struct HistoryPageHeader {
+  uint32_t magic;
+  uint32_t sequence;   // Increases by one per page written, never reused
+  uint32_t firstTime;  // History time of the page's first record
+  uint32_t reserved;
+};
+
+// Fixed-point sample; time is written last so an erased time word marks a free slot
+struct HistoryRecord {
+  int16_t temperature;   // 0.01 °C
+  uint16_t humidity;     // 0.01 %
+  uint16_t pressure;     // 0.1 mbar
+  uint16_t flags;        // HISTORY_FLAG_*
+  uint32_t time;         // History seconds
+};
+
+#define HISTORY_FLAG_BOOT   0x0001     // First sample after a reset (a gap may precede it)
+#define HISTORY_RECORDS_PER_PAGE ((HISTORY_PAGE_SIZE - sizeof(HistoryPageHeader)) / sizeof(HistoryRecord))
+
+static_assert(sizeof(HistoryRecord) == 12, "HistoryRecord must stay 12 bytes");
+
+enum HistoryChannel { HISTORY_TEMPERATURE, HISTORY_HUMIDITY, HISTORY_PRESSURE, HISTORY_CHANNEL_COUNT };
+const char *const historyChannelNames[HISTORY_CHANNEL_COUNT] = {"temperature", "humidity", "pressure"};
+
+rtos::Mutex historyMutex;       // Guards the head position; readers only take it to snapshot
+int historyHeadPage = -1;       // Page being filled, -1 until the first append
+uint32_t historyHeadSlot = 0;   // Next free record slot in the head page
+uint32_t historyHeadSequence = 0;
+int32_t historyTimeOffset = 0;  // History time = uptime seconds + offset
+bool historyBootPending = true;
+bool historyDisabled = false;   // Set if the firmware image reaches into the history sectors
+
+// End of the program image in flash (code + initialised data); weak so a linker script
+// without these symbols just skips the overlap check
+extern uint32_t __etext __attribute__((weak));
+extern uint32_t __data_start__ __attribute__((weak));
+extern uint32_t __data_end__ __attribute__((weak));
+
+inline uint32_t historyPageAddress(int page) {
+  return HISTORY_BASE_ADDRESS + page * HISTORY_PAGE_SIZE;
+}
+
+inline uint32_t historyRecordAddress(int page, uint32_t slot) {
+  return historyPageAddress(page) + sizeof(HistoryPageHeader) + slot * sizeof(HistoryRecord);
+}
+
+inline const HistoryPageHeader *historyPage(int page) {
+  return (const HistoryPageHeader *)historyPageAddress(page);
+}
+
+inline const HistoryRecord *historyRecords(int page) {
+  return (const HistoryRecord *)(historyPage(page) + 1);
+}
+
+inline bool historyPageValid(int page) {
+  return historyPage(page)->magic == HISTORY_PAGE_MAGIC;
+}
+
+inline bool historySlotErased(const HistoryRecord *r) {
+  const uint32_t *w = (const uint32_t *)r;
+  return w[0] == 0xFFFFFFFF && w[1] == 0xFFFFFFFF && w[2] == 0xFFFFFFFF;
+}
+
+uint32_t historyNow() {
+  return millis() / 1000 + historyTimeOffset;
+}
+
+// Boot: find the newest page and its first free slot, and resume history time after it
+void historyInit() {
+  if (&__etext != NULL) {
+    uintptr_t imageEnd = (uintptr_t)&__etext + ((uintptr_t)&__data_end__ - (uintptr_t)&__data_start__);
+    if (imageEnd > HISTORY_BASE_ADDRESS) {
+      LOG_ERROR("History disabled: firmware image ends at 0x%08lx, inside the history sectors",
+                (unsigned long)imageEnd);
+      historyDisabled = true;
+      return;
+    }
   }
   
-  // Hash SSID (32 bytes)
-  for (int i = 0; i < 32; i++) {
-    calculatedChecksum ^= flashConfig->ssid[i];
+  historyHeadPage = -1;
+  for (int page = 0; page < HISTORY_PAGE_COUNT; page++) {
+    if (historyPageValid(page) &&
+        (historyHeadPage < 0 || (int32_t)(historyPage(page)->sequence - historyHeadSequence) > 0)) {
+      historyHeadPage = page;
+      historyHeadSequence = historyPage(page)->sequence;
+    }
   }
   
-  // Hash password (64 bytes)
-  for (int i = 0; i < 64; i++) {
-    calculatedChecksum ^= flashConfig->password[i];
+  uint32_t lastTime = 0;
+  if (historyHeadPage >= 0) {
+    const HistoryRecord *records = historyRecords(historyHeadPage);
+    lastTime = historyPage(historyHeadPage)->firstTime;
+    historyHeadSlot = 0;
+    // Skip used slots, including one torn by a reset (data programmed, time still erased)
+    while (historyHeadSlot < HISTORY_RECORDS_PER_PAGE && !historySlotErased(&records[historyHeadSlot])) {
+      if (records[historyHeadSlot].time != 0xFFFFFFFF) lastTime = records[historyHeadSlot].time;
+      historyHeadSlot++;
+    }
   }
+  historyTimeOffset = (int32_t)(lastTime + HISTORY_SAMPLE_INTERVAL) - (int32_t)(millis() / 1000);
   
-  // Hash MQTT server (64 bytes)
-  for (int i = 0; i < 64; i++) {
-    calculatedChecksum ^= flashConfig->mqttServer[i];
+  LOG_INFO("History: head page %d slot %lu, resuming at t=%lu",
+           historyHeadPage, (unsigned long)historyHeadSlot, (unsigned long)historyNow());
+}
+
+// Start a new page after the head, erasing its sector if we are entering one
+bool historyStartPage(uint32_t firstTime) {
+  int page = historyHeadPage < 0 ? 0 : (historyHeadPage + 1) % HISTORY_PAGE_COUNT;
+  if (page % HISTORY_PAGES_PER_SECTOR == 0) {
+    unsigned long start = millis();
+    FLASH_EraseInitTypeDef erase;
+    uint32_t sectorError = 0;
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    erase.Sector = HISTORY_SECTOR_FIRST + page / HISTORY_PAGES_PER_SECTOR;
+    erase.NbSectors = 1;
+    if (HAL_FLASHEx_Erase(&erase, &sectorError) != HAL_OK) {
+      LOG_ERROR("History: sector erase failed");
+      return false;
+    }
+    LOG_INFO("History: recycled sector %lu in %lu ms", (unsigned long)erase.Sector, millis() - start);
+  } else if (historyPageValid(page) || !historySlotErased(historyRecords(page))) {
+    return false;  // Not blank (shouldn't happen); leave it for the next sector recycle
   }
   
-  // Hash MQTT port (4 bytes)
-  uint8_t* portBytes = (uint8_t*)&flashConfig->mqttPort;
-  for (int i = 0; i < 4; i++) {
-    calculatedChecksum ^= portBytes[i];
+  HistoryPageHeader header = {HISTORY_PAGE_MAGIC, historyHeadSequence + 1, firstTime, 0xFFFFFFFF};
+  if (!configProgramWords(historyPageAddress(page), &header, sizeof(header))) {
+    return false;
   }
-  
-  // Hash MQTT topic (64 bytes)
-  for (int i = 0; i < 64; i++) {
-    calculatedChecksum ^= flashConfig->mqttTopic[i];
+  historyHeadPage = page;
+  historyHeadSequence = header.sequence;
+  historyHeadSlot = 0;
+  return true;
+}
+
+// Called by loop() after each sensor sample (three data words and the time word)
+void historyAppend(float temperature, float humidity, float pressure) {
+  if (historyDisabled) return;
+  
+  HistoryRecord record;
+  record.temperature = (int16_t)lroundf(temperature * 100);
+  record.humidity = (uint16_t)lroundf(constrain(humidity, 0, 100) * 100);
+  record.pressure = (uint16_t)lroundf(constrain(pressure, 0, 6553) * 10);
+  record.flags = historyBootPending ? HISTORY_FLAG_BOOT : 0;
+  record.time = historyNow();
+  
+  historyMutex.lock();
+  HAL_FLASH_Unlock();
+  bool ok = true;
+  if (historyHeadPage < 0 || historyHeadSlot >= HISTORY_RECORDS_PER_PAGE) {
+    ok = historyStartPage(record.time);
   }
-  
-  Serial.print("Stored checksum: 0x");
-  Serial.println(flashConfig->checksum, 16);
-  Serial.print("Calculated checksum: 0x");
-  Serial.println(calculatedChecksum, 16);
-  
-  if (calculatedChecksum != flashConfig->checksum) {
-    Serial.println("Flash configuration checksum mismatch");
-    return false;
+  if (ok) {
+    uint32_t address = historyRecordAddress(historyHeadPage, historyHeadSlot);
+    // Data words first, time word last - see HistoryRecord
+    ok = configProgramWords(address, &record, offsetof(HistoryRecord, time)) &&
+         configProgramWords(address + offsetof(HistoryRecord, time), &record.time, sizeof(record.time));
+    historyHeadSlot++;  // Even on failure: a half-written slot can't be reused
   }
+  HAL_FLASH_Lock();
+  historyMutex.unlock();
   
-  // Copy valid configuration from Flash to RAM
-  memcpy(&config, flashConfig, sizeof(DeviceConfig));
-  Serial.println("Valid configuration loaded from Flash!");
-  return true;
+  if (ok) historyBootPending = false;
 }
 
-// Legacy variables for compatibility
-// DNS and MQTT globals
-WiFiClient mqttWifiClient;
-IPAddress cachedMqttIP;
-bool mqttIPResolved = false;
+// Read cursor over stored records in time order; records point straight into flash
+struct HistoryCursor {
+  int page;
+  uint32_t slot;
+  uint32_t sequence;   // Expected sequence of 'page'; a mismatch means it was recycled under us
+  uint32_t endSequence;
+  uint32_t endSlot;    // Snapshot of the head when the cursor was opened
+};
 
-// Sensor variables  
-DevI2C *i2c;
-HTS221Sensor *ht_sensor;
-LPS22HBSensor *pressure_sensor;
-LSM6DSLSensor *acc_gyro;
-LIS2MDLSensor *magnetometer;
+const HistoryRecord *historyNext(HistoryCursor &cur) {
+  while (cur.page >= 0) {
+    const HistoryPageHeader *header = historyPage(cur.page);
+    if (header->magic != HISTORY_PAGE_MAGIC || header->sequence != cur.sequence) {
+      cur.page = -1;  // Recycled while we were reading
+      return NULL;
+    }
+    bool headPage = cur.sequence == cur.endSequence;
+    uint32_t limit = headPage ? cur.endSlot : HISTORY_RECORDS_PER_PAGE;
+    while (cur.slot < limit) {
+      const HistoryRecord *r = &historyRecords(cur.page)[cur.slot++];
+      if (r->time != 0xFFFFFFFF) return r;  // Skip torn slots
+    }
+    if (headPage) {
+      cur.page = -1;
+      return NULL;
+    }
+    cur.page = (cur.page + 1) % HISTORY_PAGE_COUNT;
+    cur.sequence++;
+    cur.slot = 0;
+  }
+  return NULL;
+}
 
-// RGB LED instance
-RGB_LED rgbLED;
+// Position at the first record with time >= from, using the page headers' time index
+void historyOpen(HistoryCursor &cur, uint32_t from) {
+  historyMutex.lock();
+  cur.endSequence = historyHeadSequence;
+  cur.endSlot = historyHeadSlot;
+  int head = historyHeadPage;
+  historyMutex.unlock();
+  
+  cur.page = -1;
+  if (head < 0) return;
+  
+  // Oldest valid page is the first valid one after the head, going round the ring
+  int start = -1;
+  for (int i = 1; i <= HISTORY_PAGE_COUNT; i++) {
+    int page = (head + i) % HISTORY_PAGE_COUNT;
+    if (historyPageValid(page)) {
+      if (start < 0) start = page;
+      // Last page starting at or before 'from' - the match is inside it or at its successor
+      if (historyPage(page)->firstTime <= from) start = page;
+      else break;
+    }
+  }
+  cur.page = start;
+  cur.sequence = historyPage(start)->sequence;
+  cur.slot = 0;
+  while (cur.page >= 0) {
+    const HistoryRecord *r = historyNext(cur);
+    if (r == NULL || r->time >= from) {
+      if (r != NULL) cur.slot--;  // Step back so the caller's first historyNext() returns it
+      break;
+    }
+  }
+}
 
-// Control states for web interface
-bool ledEnabled = true;
-bool displayEnabled = true;
-bool mqttConnected = false;  // Global MQTT connection status
-bool wifiLedEnabled = false;  // WiFi LED control
-bool azureLedEnabled = false; // Azure LED control
-bool userLedEnabled = false;  // User LED control
+float historyValue(const HistoryRecord *r, int channel) {
+  switch (channel) {
+    case HISTORY_TEMPERATURE: return r->temperature / 100.0f;
+    case HISTORY_HUMIDITY:    return r->humidity / 100.0f;
+    default:                  return r->pressure / 10.0f;
+  }
+}
 
-// Debounce variables to prevent rapid toggling
-unsigned long lastLedChange = 0;
-unsigned long lastDisplayChange = 0;
+// Remote logging - the log drain thread also batches lines into UDP datagrams for a
+// syslog collector (config.syslogHost). Each line keeps its own "<PRI>host tag:" header,
+// lines are joined with '\n'. Datagrams are rate limited with a token bucket; while the
+// bucket is empty new lines are dropped (and counted) rather than queued without bound.
+#define SYSLOG_BATCH_SIZE     512    // Max datagram payload; stays under one Ethernet MTU
+#define SYSLOG_FLUSH_INTERVAL 1000   // Send a partial batch after this long (ms)
+#define SYSLOG_RATE           4      // Datagrams per second, sustained
+#define SYSLOG_BURST          8      // Token bucket depth
+#define SYSLOG_LOCAL_PORT     5514
+#define SYSLOG_FACILITY       16     // local0
+
+WiFiUDP syslogUdp;
+bool syslogUdpStarted = false;
+char syslogBatch[SYSLOG_BATCH_SIZE];
+int syslogBatchLen = 0;
+unsigned long syslogBatchStart = 0;
+uint32_t syslogTokens = SYSLOG_BURST * 1000;  // Milli-tokens
+unsigned long syslogLastRefill = 0;
+uint32_t syslogPendingDrops = 0;              // Dropped since the last datagram, reported in the next one
+
+// "a.b.c.d" -> IPAddress; rejects anything else (no DNS for the log collector)
+bool parseIPv4(const char *text, IPAddress &ip) {
+  int octets[4];
+  char tail;
+  if (sscanf(text, "%d.%d.%d.%d%c", &octets[0], &octets[1], &octets[2], &octets[3], &tail) != 4) {
+    return false;
+  }
+  for (int i = 0; i < 4; i++) {
+    if (octets[i] < 0 || octets[i] > 255) return false;
+  }
+  ip = IPAddress(octets[0], octets[1], octets[2], octets[3]);
+  return true;
+}
+
+bool syslogTakeToken(unsigned long now) {
+  syslogTokens += (now - syslogLastRefill) * SYSLOG_RATE;
+  syslogLastRefill = now;
+  if (syslogTokens > SYSLOG_BURST * 1000) syslogTokens = SYSLOG_BURST * 1000;
+  if (syslogTokens < 1000) return false;
+  syslogTokens -= 1000;
+  return true;
+}
+
+// Send the pending batch if a token is available; returns false if it has to wait
+bool syslogFlush(unsigned long now) {
+  if (syslogBatchLen == 0) return true;
+  if (!syslogTakeToken(now)) return false;
+  
+  IPAddress collector;
+  if (WiFi.status() == WL_CONNECTED && parseIPv4(config.syslogHost, collector)) {
+    if (!syslogUdpStarted) {
+      syslogUdp.begin(SYSLOG_LOCAL_PORT);
+      syslogUdpStarted = true;
+    }
+    syslogUdp.beginPacket(collector, config.syslogPort);
+    syslogUdp.write((const uint8_t *)syslogBatch, syslogBatchLen);
+    if (syslogUdp.endPacket()) {
+      metrics.syslogDatagrams++;
+    }
+  }
+  syslogBatchLen = 0;
+  return true;
+}
+
+void syslogAppend(uint8_t level, const char *text) {
+  static const uint8_t severities[] = {7, 3, 4, 6, 7};  // none, error, warning, info, debug
+  char line[LOG_SLOT_SIZE + 64];
+  int len;
+  if (syslogPendingDrops > 0) {
+    len = snprintf(line, sizeof(line), "<%d>%s az3166: %lu log lines dropped (rate limit)\n",
+                   SYSLOG_FACILITY * 8 + 4, config.deviceId, (unsigned long)syslogPendingDrops);
+    if (syslogBatchLen + len <= SYSLOG_BATCH_SIZE) {
+      memcpy(syslogBatch + syslogBatchLen, line, len);
+      syslogBatchLen += len;
+      syslogPendingDrops = 0;
+    }
+  }
+  len = snprintf(line, sizeof(line), "<%d>%s az3166: %s\n", SYSLOG_FACILITY * 8 + severities[level], config.deviceId, text);
+  if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+  
+  unsigned long now = millis();
+  if (syslogBatchLen + len > SYSLOG_BATCH_SIZE && !syslogFlush(now)) {
+    syslogPendingDrops++;
+    metrics.syslogDropped++;
+    return;
+  }
+  if (syslogBatchLen == 0) syslogBatchStart = now;
+  memcpy(syslogBatch + syslogBatchLen, line, len);
+  syslogBatchLen += len;
+}
+
+// Log sink installed on the drain thread; text == NULL is the idle tick
+void syslogSink(uint8_t level, const char *text) {
+  if (config.syslogHost[0] == '\0') {
+    syslogBatchLen = 0;
+    return;
+  }
+  if (text != NULL) {
+    syslogAppend(level, text);
+  } else if (syslogBatchLen > 0 && millis() - syslogBatchStart >= SYSLOG_FLUSH_INTERVAL) {
+    syslogFlush(millis());
+  }
+}
+
+// Legacy variables for compatibility
+// DNS and MQTT globals
+WiFiClient mqttWifiClient;
+IPAddress cachedMqttIP;
+bool mqttIPResolved = false;
+
+// Sensor variables  
+DevI2C *i2c;
+HTS221Sensor *ht_sensor;
+LPS22HBSensor *pressure_sensor;
+LSM6DSLSensor *acc_gyro;
+LIS2MDLSensor *magnetometer;
+
+// RGB LED instance
+RGB_LED rgbLED;
+
+// Control states for web interface
+bool ledEnabled = true;
+bool displayEnabled = true;
+bool mqttConnected = false;  // Global MQTT connection status
+bool wifiLedEnabled = false;  // WiFi LED control
+bool azureLedEnabled = false; // Azure LED control
+bool userLedEnabled = false;  // User LED control
+
+// Debounce variables to prevent rapid toggling
+unsigned long lastLedChange = 0;
+unsigned long lastDisplayChange = 0;
 const unsigned long DEBOUNCE_DELAY = 1000; // 1 second minimum between changes
 
 // WiFi retry management
@@ -281,11 +1135,11 @@ unsigned long lastWifiCheck = 0;
 unsigned long lastWifiRetry = 0;
 bool webServerStarted = false;
 const unsigned long WIFI_CHECK_INTERVAL = 5000;  // Check WiFi every 5 seconds
-const unsigned long WIFI_RETRY_INTERVAL = 30000; // Retry WiFi every 30 seconds
+const unsigned long WIFI_RETRY_INTERVAL = 30000; // Retry WiFi every 30 seconds (default, see RuntimeSettings)
 
 // Network watchdog - reboot if no network activity for 15 minutes
 unsigned long lastSuccessfulNetworkActivity = 0;
-const unsigned long NETWORK_WATCHDOG_TIMEOUT = 15 * 60 * 1000; // 15 minutes in milliseconds
+const unsigned long NETWORK_WATCHDOG_TIMEOUT = 15 * 60 * 1000; // 15 minutes in milliseconds (default, see RuntimeSettings)
 bool watchdogEnabled = true;
 
 // Global sensor values for web display
@@ -295,11 +1149,29 @@ float lastPressure = 0.0;
 float lastAccelX = 0.0, lastAccelY = 0.0, lastAccelZ = 0.0;
 float lastGyroX = 0.0, lastGyroY = 0.0, lastGyroZ = 0.0;
 float lastMagX = 0.0, lastMagY = 0.0, lastMagZ = 0.0;
+volatile uint32_t telemetrySeq = 0;  // Bumped by loop() after each complete sensor sample
+
+// Telemetry fields rendered on the telemetry page and pushed over /events; keys are the page's element ids
+struct SseField {
+  const char *key;
+  const float *value;
+  uint8_t decimals;
+};
+
+const SseField sseFields[] = {
+  {"temperature", &lastTemperature, 2}, {"humidity", &lastHumidity, 2}, {"pressure", &lastPressure, 2},
+  {"ax", &lastAccelX, 3}, {"ay", &lastAccelY, 3}, {"az", &lastAccelZ, 3},
+  {"gx", &lastGyroX, 2},  {"gy", &lastGyroY, 2},  {"gz", &lastGyroZ, 2},
+  {"mx", &lastMagX, 3},   {"my", &lastMagY, 3},   {"mz", &lastMagZ, 3},
+};
+const int SSE_FIELD_COUNT = sizeof(sseFields) / sizeof(sseFields[0]);
 
 // Sensor calibration offsets
-// Adjust these values to match your local conditions
+// Defaults - adjust them for the room at runtime through /api/settings
 const float PRESSURE_OFFSET = 141.0; // mbar offset to correct sensor reading
 const float TEMPERATURE_OFFSET = -2.0; // °C offset to correct temperature reading
+const unsigned long SENSOR_INTERVAL = 30000;   // Read sensors every 30 seconds
+const unsigned long PUBLISH_INTERVAL = 30000;  // Publish to MQTT every 30 seconds
 
 // Force front-panel status LEDs (Wi-Fi, Azure, User) off
 void disableStatusLedsOnce()
@@ -312,11 +1184,355 @@ void disableStatusLedsOnce()
   digitalWrite(LED_USER,  LOW);
 }
 
+// Actuator control - shared by the single-switch routes, /api/control and the MQTT
+// "<topic>/set" command path. The apply* helpers expect controlMutex to be held.
+enum Actuator {
+  ACT_LED,
+  ACT_DISPLAY,
+  ACT_WIFI_LED,
+  ACT_AZURE_LED,
+  ACT_USER_LED,
+  ACT_WATCHDOG,
+  ACT_COUNT
+};
+
+const char *const actuatorNames[ACT_COUNT] = {"led", "display", "wifiled", "azureled", "userled", "watchdog"};
+
+void applyLed(bool on) {
+  ledEnabled = on;
+  if (!on) rgbLED.turnOff();
+  lastLedChange = millis();
+}
+
+void applyDisplay(bool on) {
+  displayEnabled = on;
+  lastDisplayChange = millis();
+  if (on) {
+    Screen.init();
+    Screen.print(0, config.deviceId);
+    Screen.print(1, "Web Control");
+    if (WiFi.status() == WL_CONNECTED) {
+      char ipStr[16];
+      sprintf(ipStr, "%d.%d.%d.%d", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
+      Screen.print(3, ipStr);
+    }
+  } else {
+    Screen.clean();
+  }
+}
+
+void applyStatusLed(int pin, bool &enabled, bool on) {
+  enabled = on;
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, on ? HIGH : LOW);
+}
+
+void applyWatchdog(bool on) {
+  if (on && !watchdogEnabled) {
+    lastSuccessfulNetworkActivity = millis(); // Reset timer when enabling
+  }
+  watchdogEnabled = on;
+}
+
+void applyActuator(int act, bool on) {
+  switch (act) {
+    case ACT_LED:       applyLed(on); break;
+    case ACT_DISPLAY:   applyDisplay(on); break;
+    case ACT_WIFI_LED:  applyStatusLed(LED_WIFI, wifiLedEnabled, on); break;
+    case ACT_AZURE_LED: applyStatusLed(LED_AZURE, azureLedEnabled, on); break;
+    case ACT_USER_LED:  applyStatusLed(LED_USER, userLedEnabled, on); break;
+    case ACT_WATCHDOG:  applyWatchdog(on); break;
+  }
+}
+
+bool actuatorState(int act) {
+  switch (act) {
+    case ACT_LED:       return ledEnabled;
+    case ACT_DISPLAY:   return displayEnabled;
+    case ACT_WIFI_LED:  return wifiLedEnabled;
+    case ACT_AZURE_LED: return azureLedEnabled;
+    case ACT_USER_LED:  return userLedEnabled;
+    case ACT_WATCHDOG:  return watchdogEnabled;
+  }
+  return false;
+}
+
+// Accepts on/off, 1/0, true/false and (for the watchdog's legacy route) enable/disable
+bool parseSwitchValue(const char *value, int len, bool &on) {
+  const char *onValues[] = {"on", "1", "true", "enable"};
+  const char *offValues[] = {"off", "0", "false", "disable"};
+  for (int i = 0; i < 4; i++) {
+    if ((int)strlen(onValues[i]) == len && strncmp(value, onValues[i], len) == 0) { on = true; return true; }
+    if ((int)strlen(offValues[i]) == len && strncmp(value, offValues[i], len) == 0) { on = false; return true; }
+  }
+  return false;
+}
+
+// Compact status: {"led":1,"display":1,"wifiled":0,"azureled":0,"userled":0,"watchdog":1}
+int formatActuatorStatus(char *out, int outSize) {
+  int pos = snprintf(out, outSize, "{");
+  for (int i = 0; i < ACT_COUNT && pos < outSize; i++) {
+    pos += snprintf(out + pos, outSize - pos, "%s\"%s\":%d", i ? "," : "", actuatorNames[i], actuatorState(i) ? 1 : 0);
+  }
+  if (pos < outSize) pos += snprintf(out + pos, outSize - pos, "}");
+  return pos < outSize ? pos : outSize - 1;
+}
+
+// Apply "led=on&display=off&..." all-or-nothing: every pair is validated before anything changes,
+// then all changes are made under one controlMutex hold. No debounce - a batch is one request.
+bool applyActuatorBatch(const char *params, char *error, int errorSize) {
+  int8_t desired[ACT_COUNT];
+  memset(desired, -1, sizeof(desired));
+  int count = 0;
+  
+  const char *p = params;
+  while (*p) {
+    const char *end = p;
+    while (*end && *end != '&' && *end != '\n' && *end != '\r') end++;
+    const char *eq = (const char *)memchr(p, '=', end - p);
+    if (end > p) {
+      if (eq == NULL) {
+        snprintf(error, errorSize, "expected key=value");
+        return false;
+      }
+      int act = -1;
+      for (int i = 0; i < ACT_COUNT; i++) {
+        if ((int)strlen(actuatorNames[i]) == eq - p && strncmp(p, actuatorNames[i], eq - p) == 0) {
+          act = i;
+          break;
+        }
+      }
+      bool on;
+      if (act < 0) {
+        snprintf(error, errorSize, "unknown actuator '%.*s'", (int)(eq - p), p);
+        return false;
+      }
+      if (!parseSwitchValue(eq + 1, end - (eq + 1), on)) {
+        snprintf(error, errorSize, "bad value for '%s'", actuatorNames[act]);
+        return false;
+      }
+      desired[act] = on ? 1 : 0;
+      count++;
+    }
+    p = *end ? end + 1 : end;
+  }
+  
+  if (count == 0) {
+    snprintf(error, errorSize, "no actuators given");
+    return false;
+  }
+  
+  controlMutex.lock();
+  for (int i = 0; i < ACT_COUNT; i++) {
+    if (desired[i] >= 0) {
+      applyActuator(i, desired[i] == 1);
+    }
+  }
+  controlMutex.unlock();
+  
+  LOG_INFO("Actuator batch applied (%d changes)", count);
+  return true;
+}
+
+// Runtime settings - tunables that take effect without a reflash or reboot. Updates come
+// from /api/settings or "<topic>/settings" and are published double-buffered: the writer
+// fills the inactive copy and then bumps settingsGeneration, so readers never lock and
+// never see a half-updated struct. settingsGeneration is odd while a copy is being
+// written; a reader that overlapped a write to the copy it was reading retries.
+struct RuntimeSettings {
+  uint32_t sampleInterval;     // Seconds between sensor reads
+  uint32_t publishInterval;    // Seconds between MQTT publishes
+  uint32_t wifiRetryInterval;  // Seconds between WiFi reconnect attempts
+  uint32_t watchdogTimeout;    // Seconds without network before the watchdog reboots
+  float temperatureOffset;     // °C added to the HTS221 reading
+  float pressureOffset;        // mbar added to the LPS22HB reading
+};
+
+RuntimeSettings settingsBuffers[2] = {
+  {SENSOR_INTERVAL / 1000, PUBLISH_INTERVAL / 1000, WIFI_RETRY_INTERVAL / 1000, NETWORK_WATCHDOG_TIMEOUT / 1000,
+   TEMPERATURE_OFFSET, PRESSURE_OFFSET},
+};
+volatile uint32_t settingsGeneration = 0;  // Copy (generation / 2) % 2 is current
+rtos::Mutex settingsMutex;                 // Serialises writers only
+
+#define SETTINGS_PERSIST_DELAY 60000  // Batch live tuning into one flash record a minute after the last change
+
+bool settingsPersistPending = false;
+unsigned long settingsChangedAt = 0;
+
+// Tunable fields: query/JSON key, offset in RuntimeSettings, accepted range
+struct SettingDef {
+  const char *key;
+  uint16_t offset;
+  bool isFloat;
+  float minValue, maxValue;
+};
+
+const SettingDef settingDefs[] = {
+  {"sample_interval",     offsetof(RuntimeSettings, sampleInterval),    false, 5,   3600},
+  {"publish_interval",    offsetof(RuntimeSettings, publishInterval),   false, 5,   3600},
+  {"wifi_retry_interval", offsetof(RuntimeSettings, wifiRetryInterval), false, 10,  3600},
+  {"watchdog_timeout",    offsetof(RuntimeSettings, watchdogTimeout),   false, 120, 86400},
+  {"temperature_offset",  offsetof(RuntimeSettings, temperatureOffset), true,  -20, 20},
+  {"pressure_offset",     offsetof(RuntimeSettings, pressureOffset),    true,  -300, 300},
+};
+const int SETTING_COUNT = sizeof(settingDefs) / sizeof(settingDefs[0]);
+
+// Lock-free snapshot of the current settings
+void settingsRead(RuntimeSettings &out) {
+  uint32_t generation;
+  do {
+    generation = settingsGeneration;
+    __DMB();
+    out = settingsBuffers[(generation >> 1) & 1];
+    __DMB();
+    // Our copy is only rewritten by the write after next: it starts at generation + 3 if
+    // generation was even, or at generation + 2 if a write was already in progress
+  } while (settingsGeneration - generation > ((generation & 1) ? 1u : 2u));
+}
+
+// Publish new settings; readers switch over at the second generation bump
+void settingsPublish(const RuntimeSettings &next) {
+  settingsMutex.lock();
+  uint32_t generation = settingsGeneration;
+  settingsGeneration = generation + 1;  // Writing the inactive copy
+  __DMB();
+  settingsBuffers[((generation >> 1) + 1) & 1] = next;
+  __DMB();
+  settingsGeneration = generation + 2;
+  settingsMutex.unlock();
+}
+
+int formatSettings(char *out, int outSize) {
+  RuntimeSettings current;
+  settingsRead(current);
+  int pos = snprintf(out, outSize, "{");
+  for (int i = 0; i < SETTING_COUNT && pos < outSize; i++) {
+    const uint8_t *field = (const uint8_t *)&current + settingDefs[i].offset;
+    if (settingDefs[i].isFloat) {
+      pos += snprintf(out + pos, outSize - pos, "%s\"%s\":%.2f", i ? "," : "", settingDefs[i].key, *(const float *)field);
+    } else {
+      pos += snprintf(out + pos, outSize - pos, "%s\"%s\":%lu", i ? "," : "", settingDefs[i].key,
+                      (unsigned long)*(const uint32_t *)field);
+    }
+  }
+  if (pos < outSize) pos += snprintf(out + pos, outSize - pos, ",\"persist_pending\":%s}",
+                                     settingsPersistPending ? "true" : "false");
+  return pos < outSize ? pos : outSize - 1;
+}
+
+// Apply "sample_interval=10&temperature_offset=-1.5&persist=1" all-or-nothing, like
+// applyActuatorBatch. persist=1 schedules a flash write (see settingsService); without it
+// the change lasts until the next reboot.
+bool applySettingsBatch(const char *params, char *error, int errorSize) {
+  RuntimeSettings next;
+  settingsRead(next);
+  bool persist = false;
+  int count = 0;
+  
+  const char *p = params;
+  while (*p) {
+    const char *end = p;
+    while (*end && *end != '&' && *end != '\n' && *end != '\r') end++;
+    const char *eq = (const char *)memchr(p, '=', end - p);
+    if (end > p) {
+      if (eq == NULL) {
+        snprintf(error, errorSize, "expected key=value");
+        return false;
+      }
+      char value[16];
+      int valueLen = end - (eq + 1);
+      if (valueLen <= 0 || valueLen >= (int)sizeof(value)) {
+        snprintf(error, errorSize, "bad value for '%.*s'", (int)(eq - p), p);
+        return false;
+      }
+      memcpy(value, eq + 1, valueLen);
+      value[valueLen] = '\0';
+      
+      if (eq - p == 7 && strncmp(p, "persist", 7) == 0) {
+        bool on;
+        if (!parseSwitchValue(value, valueLen, on)) {
+          snprintf(error, errorSize, "bad value for 'persist'");
+          return false;
+        }
+        persist = on;
+      } else {
+        const SettingDef *def = NULL;
+        for (int i = 0; i < SETTING_COUNT; i++) {
+          if ((int)strlen(settingDefs[i].key) == eq - p && strncmp(p, settingDefs[i].key, eq - p) == 0) {
+            def = &settingDefs[i];
+            break;
+          }
+        }
+        if (def == NULL) {
+          snprintf(error, errorSize, "unknown setting '%.*s'", (int)(eq - p), p);
+          return false;
+        }
+        char *parsedEnd;
+        float number = strtof(value, &parsedEnd);
+        if (*parsedEnd != '\0' || !(number >= def->minValue && number <= def->maxValue) ||
+            (!def->isFloat && number != (float)(uint32_t)number)) {
+          snprintf(error, errorSize, "'%s' must be %s %g..%g", def->key,
+                   def->isFloat ? "in" : "an integer in", def->minValue, def->maxValue);
+          return false;
+        }
+        uint8_t *field = (uint8_t *)&next + def->offset;
+        if (def->isFloat) *(float *)field = number;
+        else *(uint32_t *)field = (uint32_t)number;
+        count++;
+      }
+    }
+    p = *end ? end + 1 : end;
+  }
+  
+  if (count == 0 && !persist) {
+    snprintf(error, errorSize, "no settings given");
+    return false;
+  }
+  
+  if (count > 0) settingsPublish(next);
+  if (persist) {
+    settingsPersistPending = true;
+    settingsChangedAt = millis();
+  }
+  LOG_INFO("Settings updated (%d changes%s)", count, persist ? ", flash write scheduled" : "");
+  return true;
+}
+
+// Boot: restore settings saved by an earlier persist=1 (older or newer layouts keep their common prefix)
+void settingsInit() {
+  uint16_t length;
+  const void *payload = configStoreRead(CONFIG_RECORD_SETTINGS, &length);
+  if (payload == NULL) return;
+  
+  RuntimeSettings stored = settingsBuffers[0];
+  memcpy(&stored, payload, length < sizeof(stored) ? length : sizeof(stored));
+  settingsPublish(stored);
+  LOG_INFO("Runtime settings restored from flash");
+}
+
+// Called from loop(): write the pending settings once they have been quiet for a while,
+// so a tuning session costs one flash record instead of one per change
+void settingsService(unsigned long now) {
+  if (!settingsPersistPending || now - settingsChangedAt < SETTINGS_PERSIST_DELAY) return;
+  settingsPersistPending = false;
+  
+  RuntimeSettings current;
+  settingsRead(current);
+  controlMutex.lock();  // configStoreWrite is shared with /save-config
+  bool saved = configStoreWrite(CONFIG_RECORD_SETTINGS, &current, sizeof(current));
+  controlMutex.unlock();
+  if (saved) {
+    LOG_INFO("Runtime settings saved to flash");
+  } else {
+    LOG_ERROR("Runtime settings save failed");
+  }
+}
+
 // System reboot function using STM32 HAL
 void systemReboot() {
-  Serial.println("\n========================================");
-  Serial.println("NETWORK WATCHDOG: Initiating system reboot...");
-  Serial.println("========================================\n");
+  LOG_ERROR("NETWORK WATCHDOG: Initiating system reboot...");
+  logFlush();
   Serial.flush(); // Ensure message is sent before reboot
   
   // Visual indication before reboot
@@ -350,22 +1566,25 @@ void checkNetworkWatchdog() {
     hasNetworkActivity = true;
   }
   
+  RuntimeSettings settings;
+  settingsRead(settings);
+  unsigned long timeout = settings.watchdogTimeout * 1000UL;
+  
   // Update last successful activity timestamp if we have connectivity
   if (hasNetworkActivity) {
+    if (now - lastSuccessfulNetworkActivity > timeout / 2) {
+      metrics.watchdogNearMisses++;  // Recovered, but the reboot was less than half a timeout away
+    }
     lastSuccessfulNetworkActivity = now;
   } else {
     // No network activity - check if timeout exceeded
     unsigned long timeSinceLastActivity = now - lastSuccessfulNetworkActivity;
     
-    if (timeSinceLastActivity > NETWORK_WATCHDOG_TIMEOUT) {
+    if (timeSinceLastActivity > timeout) {
       // Timeout exceeded - log and reboot
-      Serial.println("\n!!! NETWORK WATCHDOG TIMEOUT !!!");
-      Serial.print("No network activity for ");
-      Serial.print(timeSinceLastActivity / 1000);
-      Serial.println(" seconds");
-      Serial.print("Threshold: ");
-      Serial.print(NETWORK_WATCHDOG_TIMEOUT / 1000);
-      Serial.println(" seconds");
+      LOG_ERROR("!!! NETWORK WATCHDOG TIMEOUT !!!");
+      LOG_ERROR("No network activity for %lu seconds", timeSinceLastActivity / 1000);
+      LOG_ERROR("Threshold: %lu seconds", timeout / 1000);
       
       if (displayEnabled) {
         Screen.clean();
@@ -380,29 +1599,16 @@ void checkNetworkWatchdog() {
       static unsigned long lastWarning = 0;
       if (now - lastWarning > 60000) {
         lastWarning = now;
-        Serial.print("WARNING: No network activity for ");
-        Serial.print(timeSinceLastActivity / 1000);
-        Serial.print(" seconds (timeout in ");
-        Serial.print((NETWORK_WATCHDOG_TIMEOUT - timeSinceLastActivity) / 1000);
-        Serial.println(" seconds)");
+        LOG_WARN("No network activity for %lu seconds (timeout in %lu seconds)", timeSinceLastActivity / 1000, (unsigned long)((timeout - timeSinceLastActivity) / 1000));
       }
     }
   }
 }
 
 // Configuration management functions
-uint8_t calculateChecksum(const DeviceConfig* cfg) {
-  uint8_t checksum = 0;
-  const uint8_t* data = (const uint8_t*)cfg;
-  for (int i = 0; i < sizeof(DeviceConfig) - 1; i++) {  // -1 to exclude checksum field
-    checksum ^= data[i];
-  }
-  return checksum;
-}
-
 void loadDefaultConfig() {
   Serial.println("Loading default configuration...");
-  config.magic[0] = 'A'; config.magic[1] = 'Z'; config.magic[2] = '3'; config.magic[3] = '1';
+  config.magic[0] = 'A'; config.magic[1] = 'Z'; config.magic[2] = '3'; config.magic[3] = '2';
   strcpy(config.deviceId, "SensorStation_01");
   strcpy(config.model, "az3166");
   strcpy(config.location, "Garage");
@@ -411,7 +1617,8 @@ void loadDefaultConfig() {
   strcpy(config.mqttServer, "mqtt.example.com");
   config.mqttPort = 1883;
   strcpy(config.mqttTopic, "sensors/az3166");
-  config.checksum = calculateChecksum(&config);
+  config.syslogHost[0] = '\0';
+  config.syslogPort = 514;
 }
 
 String readSerialString(const char* prompt, const char* defaultValue, int maxLength) {
@@ -487,8 +1694,19 @@ void configureDevice() {
   String newMqttTopic = readSerialString("MQTT Topic", config.mqttTopic, sizeof(config.mqttTopic));
   strcpy(config.mqttTopic, newMqttTopic.c_str());
   
-  // Update checksum
-  config.checksum = calculateChecksum(&config);
+  // Remote log collector (blank to disable)
+  String newSyslogHost = readSerialString("Syslog Host (IPv4, blank = off)", config.syslogHost, sizeof(config.syslogHost));
+  IPAddress syslogIP;
+  if (newSyslogHost.length() == 0 || parseIPv4(newSyslogHost.c_str(), syslogIP)) {
+    strcpy(config.syslogHost, newSyslogHost.c_str());
+  } else {
+    Serial.println("Invalid IPv4 address, syslog left unchanged");
+  }
+  String newSyslogPort = readSerialString("Syslog Port", String(config.syslogPort).c_str(), 8);
+  config.syslogPort = newSyslogPort.toInt();
+  if (config.syslogPort <= 0 || config.syslogPort > 65535) {
+    config.syslogPort = 514;
+  }
   
   Serial.println("\n=== CONFIGURATION SUMMARY ===");
   Serial.print("Device ID: "); Serial.println(config.deviceId);
@@ -499,6 +1717,8 @@ void configureDevice() {
   Serial.print("MQTT Server: "); Serial.println(config.mqttServer);
   Serial.print("MQTT Port: "); Serial.println(config.mqttPort);
   Serial.print("MQTT Topic: "); Serial.println(config.mqttTopic);
+  Serial.print("Syslog: "); Serial.print(config.syslogHost[0] ? config.syslogHost : "off");
+  Serial.print(":"); Serial.println(config.syslogPort);
   
   // Save configuration to Flash memory
   if (saveConfigToFlash()) {
@@ -530,71 +1750,102 @@ bool checkForConfigurationMode() {
 
 // Simplified DNS Resolution - use direct IP for now, add full DNS later
 bool resolveHostname(const char* hostname, IPAddress& ip) {
-  Serial.print("Resolving hostname: ");
-  Serial.println(hostname);
+  LOG_DEBUG("Resolving hostname: %s", hostname);
   
   // For now, use the direct IP we know works
   // TODO: Implement full UDP DNS when we have time
   if (strcmp(hostname, "mqtt.dcasati.net") == 0) {
     ip = IPAddress(172, 16, 5, 241);
-    Serial.print("Using cached IP: ");
-    Serial.println(ip);
+    LOG_DEBUG("Using cached IP: %d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
     return true;
   }
   
-  Serial.println("Hostname not in cache");
+  LOG_INFO("Hostname not in cache");
   return false;
 }
 
+// Command topics: "<mqttTopic>/set" takes actuator batches (replies on "<mqttTopic>/state"),
+// "<mqttTopic>/settings" takes runtime settings (replies on "<mqttTopic>/settings/state")
+void mqttCommandTopic(char *out, int outSize, const char *suffix) {
+  snprintf(out, outSize, "%s/%s", config.mqttTopic, suffix);
+}
+
+// Subscribe (QoS 0) to both command topics on the current connection
+bool subscribeMQTTCommands() {
+  const char *const suffixes[] = {"set", "settings"};
+  char topics[2][80];
+  int payloadLen = 2;  // Packet identifier
+  for (int i = 0; i < 2; i++) {
+    mqttCommandTopic(topics[i], sizeof(topics[i]), suffixes[i]);
+    payloadLen += 2 + strlen(topics[i]) + 1;
+  }
+  
+  uint8_t packet[176];
+  int pos = 0;
+  packet[pos++] = 0x82;                    // SUBSCRIBE (reserved flags 0010)
+  if (payloadLen >= 128) {                 // Remaining length, 1 or 2 bytes for topics up to 63 chars
+    packet[pos++] = (payloadLen & 0x7F) | 0x80;
+    packet[pos++] = payloadLen >> 7;
+  } else {
+    packet[pos++] = payloadLen;
+  }
+  packet[pos++] = 0x00; packet[pos++] = 0x01;  // Packet identifier
+  for (int i = 0; i < 2; i++) {
+    int topicLen = strlen(topics[i]);
+    packet[pos++] = (topicLen >> 8) & 0xFF;
+    packet[pos++] = topicLen & 0xFF;
+    memcpy(&packet[pos], topics[i], topicLen);
+    pos += topicLen;
+    packet[pos++] = 0x00;                  // Requested QoS 0
+    LOG_INFO("Subscribing to MQTT command topic: %s", topics[i]);
+  }
+  
+  size_t written = mqttWifiClient.write(packet, pos);
+  metrics.mqttBytesWritten += written;
+  return written == (size_t)pos;
+}
+
 // Simple MQTT Connect
 bool connectMQTT() {
+  PROFILE_SPAN(PROF_CONNECT_MQTT);
   // Use cached IP if available
   IPAddress targetIP;
   if (mqttIPResolved) {
     targetIP = cachedMqttIP;
-    Serial.print("Using cached MQTT IP: ");
-    Serial.println(targetIP);
+    LOG_DEBUG("Using cached MQTT IP: %d.%d.%d.%d", targetIP[0], targetIP[1], targetIP[2], targetIP[3]);
   } else {
-    Serial.println("Resolving MQTT server IP...");
+    LOG_INFO("Resolving MQTT server IP...");
     if (resolveHostname(config.mqttServer, targetIP)) {
       cachedMqttIP = targetIP;
       mqttIPResolved = true;
     } else {
-      Serial.println("Failed to resolve MQTT server");
+      LOG_ERROR("Failed to resolve MQTT server");
       return false;
     }
   }
   
   // Test basic connectivity first
-  Serial.println("Testing basic network connectivity...");
+  LOG_DEBUG("Testing basic network connectivity...");
   WiFiClient testClient;
   if (testClient.connect(targetIP, config.mqttPort)) {
-    Serial.println("Basic connectivity test passed (port 1883)");
+    LOG_DEBUG("Basic connectivity test passed (port %d)", config.mqttPort);
     testClient.stop();
     delay(100); // Small delay before main connection
   } else {
-    Serial.println("Basic connectivity test failed (port 1883)");
+    LOG_WARN("Basic connectivity test failed (port %d)", config.mqttPort);
   }
   
-  Serial.print("Connecting to MQTT broker at ");
-  Serial.print(targetIP);
-  Serial.print(":");
-  Serial.println(config.mqttPort);
-  
-  Serial.println("Attempting TCP connection...");
-  Serial.print("WiFi status before connect: ");
-  Serial.println(WiFi.status());
+  LOG_INFO("Connecting to MQTT broker at %d.%d.%d.%d:%d",
+           targetIP[0], targetIP[1], targetIP[2], targetIP[3], config.mqttPort);
+  LOG_DEBUG("WiFi status before connect: %d", WiFi.status());
   
   if (!mqttWifiClient.connect(targetIP, config.mqttPort)) {
-    Serial.println("TCP connection failed");
-    Serial.print("WiFi status after failed connect: ");
-    Serial.println(WiFi.status());
-    Serial.print("Client connected status: ");
-    Serial.println(mqttWifiClient.connected());
+    LOG_ERROR("TCP connection failed (WiFi status %d, client connected %d)",
+              WiFi.status(), mqttWifiClient.connected());
     return false;
   }
   
-  Serial.println("TCP connected, sending MQTT CONNECT...");
+  LOG_DEBUG("TCP connected, sending MQTT CONNECT...");
   
   // Build MQTT CONNECT packet
   uint8_t packet[128];
@@ -621,23 +1872,16 @@ bool connectMQTT() {
   packet[lenPos] = pos - 2;
   
   // Send packet
-  Serial.print("Sending MQTT CONNECT packet (");
-  Serial.print(pos);
-  Serial.print(" bytes): ");
-  for (int i = 0; i < pos; i++) {
-    Serial.print("0x");
-    if (packet[i] < 16) Serial.print("0");
-    Serial.print(packet[i], 16);  // 16 for hex format
-    Serial.print(" ");
-  }
-  Serial.println();
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  char hex[LOG_SLOT_SIZE];
+  LOG_DEBUG("MQTT CONNECT (%d bytes): %s", pos, formatHex(hex, sizeof(hex) - 32, packet, pos));
+#endif
   
-  mqttWifiClient.write(packet, pos);
-  Serial.println("Packet sent, waiting for CONNACK...");
+  metrics.mqttBytesWritten += mqttWifiClient.write(packet, pos);
   
   // Wait for CONNACK
   unsigned long timeout = millis() + 5000;
-  Serial.println("Waiting for CONNACK response...");
+  LOG_DEBUG("Packet sent, waiting for CONNACK...");
   
   // Wait for at least some data
   while (millis() < timeout && mqttWifiClient.available() == 0) {
@@ -645,59 +1889,43 @@ bool connectMQTT() {
   }
   
   if (mqttWifiClient.available() > 0) {
-    Serial.print("Received ");
-    Serial.print(mqttWifiClient.available());
-    Serial.println(" bytes from broker");
-    
     // Give it a moment for the complete packet to arrive
     delay(50);
-    
-    Serial.print("Total bytes available: ");
-    Serial.println(mqttWifiClient.available());
+    LOG_DEBUG("Received %d bytes from broker", mqttWifiClient.available());
   }
   
   if (mqttWifiClient.available() >= 4) {
     uint8_t response[4];
     mqttWifiClient.read(response, 4);
     
-    Serial.print("CONNACK response: ");
-    for (int i = 0; i < 4; i++) {
-      Serial.print("0x");
-      if (response[i] < 16) Serial.print("0");
-      Serial.print(response[i], 16);
-      Serial.print(" ");
-    }
-    Serial.println();
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    LOG_DEBUG("CONNACK response: %s", formatHex(hex, sizeof(hex) - 32, response, 4));
+#endif
     
     if (response[0] == 0x20 && response[3] == 0x00) {
-      Serial.println("MQTT connected successfully!");
+      LOG_INFO("MQTT connected successfully!");
+      subscribeMQTTCommands();
       return true;
     } else {
-      Serial.print("MQTT CONNACK failed, return code: ");
-      Serial.println(response[3]);
+      LOG_ERROR("MQTT CONNACK failed, return code: %d", response[3]);
     }
   } else if (mqttWifiClient.available() >= 1) {
     // Try to read whatever we got
     uint8_t partialResponse[4] = {0};
     int bytesRead = mqttWifiClient.read(partialResponse, mqttWifiClient.available());
-    Serial.print("Received CONNACK (");
-    Serial.print(bytesRead);
-    Serial.println(" bytes): ");
-    for (int i = 0; i < bytesRead; i++) {
-      Serial.print("0x");
-      if (partialResponse[i] < 16) Serial.print("0");
-      Serial.print(partialResponse[i], 16);
-      Serial.print(" ");
-    }
-    Serial.println();
+    
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    LOG_DEBUG("Received CONNACK (%d bytes): %s", bytesRead, formatHex(hex, sizeof(hex) - 32, partialResponse, bytesRead));
+#endif
     
     // If we got 0x20, that's the CONNACK message type - treat as success
     if (partialResponse[0] == 0x20) {
-      Serial.println("MQTT connection successful (broker sent CONNACK 0x20)!");
+      LOG_INFO("MQTT connection successful (broker sent CONNACK 0x20)!");
+      subscribeMQTTCommands();
       return true;
     }
   } else {
-    Serial.println("MQTT CONNACK timeout - insufficient data");
+    LOG_ERROR("MQTT CONNACK timeout - insufficient data");
   }
   
   mqttWifiClient.stop();
@@ -706,8 +1934,10 @@ bool connectMQTT() {
 
 // Simple MQTT Publish
 bool publishMQTT(const char* topic, const char* payload) {
+  PROFILE_SPAN(PROF_PUBLISH_MQTT);
   if (!mqttWifiClient.connected()) {
-    Serial.println("MQTT not connected");
+    LOG_WARN("MQTT not connected");
+    metrics.mqttPublishFailures++;
     return false;
   }
   
@@ -732,7 +1962,8 @@ bool publishMQTT(const char* topic, const char* payload) {
     packet[pos++] = remainingLength / 128;
   } else {
     // For very large packets, we'd need more bytes, but this should be sufficient
-    Serial.println("MQTT payload too large");
+    LOG_WARN("MQTT payload too large");
+    metrics.mqttPublishFailures++;
     return false;
   }
   
@@ -749,781 +1980,2100 @@ bool publishMQTT(const char* topic, const char* payload) {
   pos += payloadLen;
   
   // Debug output
-  Serial.print("MQTT PUBLISH packet (");
-  Serial.print(pos);
-  Serial.print(" bytes): Topic=");
-  Serial.print(topic);
-  Serial.print(", Payload size=");
-  Serial.println(payloadLen);
+  LOG_DEBUG("MQTT PUBLISH packet (%d bytes): Topic=%s, Payload size=%d", pos, topic, payloadLen);
   
+  unsigned long writeStart = millis();
   size_t written = mqttWifiClient.write(packet, pos);
-  Serial.print("MQTT bytes written: ");
-  Serial.print(written);
-  Serial.print("/");
-  Serial.println(pos);
+  metrics.mqttBytesWritten += written;
+  LOG_DEBUG("MQTT bytes written: %u/%d", (unsigned)written, pos);
   
   if (written != pos) {
-    Serial.println("MQTT write failed!");
+    LOG_ERROR("MQTT write failed!");
+    metrics.mqttPublishFailures++;
     return false;
   }
   
-  mqttWifiClient.flush();
-  Serial.println("MQTT message published and flushed");
-  return true;
+  mqttWifiClient.flush();
+  histogramObserve(metrics.mqttPublishTime, millis() - writeStart);
+  metrics.mqttPublishes++;
+  LOG_DEBUG("MQTT message published and flushed");
+  return true;
+}
+
+// Read exactly len bytes from the broker, giving up after timeoutMs
+bool mqttReadBytes(uint8_t *buf, int len, unsigned long timeoutMs) {
+  unsigned long start = millis();
+  int got = 0;
+  while (got < len) {
+    if (mqttWifiClient.available() > 0) {
+      int c = mqttWifiClient.read();
+      if (c < 0) return false;
+      buf[got++] = (uint8_t)c;
+    } else if (millis() - start > timeoutMs) {
+      return false;
+    } else {
+      Thread::wait(1);
+    }
+  }
+  return true;
+}
+
+#define MQTT_INCOMING_MAX 256  // Command batches are tiny; anything bigger is drained and dropped
+
+// Drain packets from the broker: PUBLISH on "<topic>/set" applies an actuator batch and
+// answers with the compact status on "<topic>/state"; "<topic>/settings" does the same for
+// runtime settings. SUBACK/PINGRESP are ignored.
+void serviceMqttIncoming() {
+  static uint8_t packet[MQTT_INCOMING_MAX];
+  
+  while (mqttWifiClient.available() > 0) {
+    uint8_t header;
+    if (!mqttReadBytes(&header, 1, 200)) return;
+    
+    // Remaining length: up to 4 bytes, 7 bits each
+    uint32_t remaining = 0;
+    int shift = 0;
+    uint8_t b;
+    do {
+      if (shift > 21 || !mqttReadBytes(&b, 1, 200)) {
+        LOG_WARN("MQTT: malformed incoming packet, dropping connection");
+        mqttWifiClient.stop();
+        mqttConnected = false;
+        return;
+      }
+      remaining |= (uint32_t)(b & 0x7F) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    
+    if (remaining > MQTT_INCOMING_MAX) {
+      LOG_WARN("MQTT: incoming packet too large, skipping");
+      for (uint32_t i = 0; i < remaining; i++) {
+        if (!mqttReadBytes(&b, 1, 1000)) return;
+      }
+      continue;
+    }
+    if (!mqttReadBytes(packet, remaining, 1000)) return;
+    
+    if ((header & 0xF0) != 0x30 || remaining < 2) {
+      continue;  // Only PUBLISH carries commands
+    }
+    
+    int topicLen = (packet[0] << 8) | packet[1];
+    int payloadStart = 2 + topicLen;
+    if ((header & 0x06) != 0) payloadStart += 2;  // QoS > 0 carries a packet id
+    if (payloadStart > (int)remaining) continue;
+    
+    char setTopic[80];
+    char settingsTopic[80];
+    mqttCommandTopic(setTopic, sizeof(setTopic), "set");
+    mqttCommandTopic(settingsTopic, sizeof(settingsTopic), "settings");
+    bool isSettings = topicLen == (int)strlen(settingsTopic) && memcmp(&packet[2], settingsTopic, topicLen) == 0;
+    if (!isSettings && (topicLen != (int)strlen(setTopic) || memcmp(&packet[2], setTopic, topicLen) != 0)) {
+      continue;
+    }
+    
+    char params[MQTT_INCOMING_MAX + 1];
+    int payloadLen = remaining - payloadStart;
+    memcpy(params, &packet[payloadStart], payloadLen);
+    params[payloadLen] = '\0';
+    
+    LOG_INFO("MQTT command: %s", params);
+    
+    char reply[256];
+    char error[64];
+    bool ok = isSettings ? applySettingsBatch(params, error, sizeof(error))
+                         : applyActuatorBatch(params, error, sizeof(error));
+    if (!ok) {
+      snprintf(reply, sizeof(reply), "{\"error\":\"%s\"}", error);
+    } else if (isSettings) {
+      formatSettings(reply, sizeof(reply));
+    } else {
+      formatActuatorStatus(reply, sizeof(reply));
+    }
+    char stateTopic[80];
+    mqttCommandTopic(stateTopic, sizeof(stateTopic), isSettings ? "settings/state" : "state");
+    publishMQTT(stateTopic, reply);
+  }
+}
+
+// Web server functions - optimized for speed
+
+// Standard HTTP 200 header with no-cache semantics
+// Pass HTTP_CHUNKED as contentLength for bodies streamed with PageWriter
+#define HTTP_CHUNKED -1
+
+void sendHttpHeader(WiFiClient &client, int contentLength, const char *contentType = "text/html") {
+  char header[256];
+  char lengthHeader[40];
+  
+  if (contentLength == HTTP_CHUNKED) {
+    snprintf(lengthHeader, sizeof(lengthHeader), "Transfer-Encoding: chunked\r\n");
+  } else {
+    snprintf(lengthHeader, sizeof(lengthHeader), "Content-Length: %d\r\n", contentLength);
+  }
+  
+  int headerLen = snprintf(
+    header,
+    sizeof(header),
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: %s\r\n"
+    "Connection: close\r\n"
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+    "Pragma: no-cache\r\n"
+    "Expires: 0\r\n"
+    "%s"
+    "\r\n",
+    contentType,
+    lengthHeader
+  );
+  
+  if (headerLen < 0) {
+    headerLen = 0;
+  } else if (headerLen >= (int)sizeof(header)) {
+    headerLen = sizeof(header) - 1;
+  }
+  
+  client.write((const uint8_t *)header, headerLen);
+}
+
+// 503 for clients turned away by a full worker pool or subscriber table
+void httpSendUnavailable(WiFiClient &client) {
+  const char *resp =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Connection: close\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+  client.write((const uint8_t *)resp, strlen(resp));
+  client.flush();
+  Thread::wait(10);
+  client.stop();
+}
+
+// Chunked page renderer - pages are streamed through a small fixed buffer using
+// Transfer-Encoding: chunked, so page size is no longer limited by stack buffers
+#define PAGE_CHUNK_SIZE   512     // Payload bytes per chunk
+#define PAGE_CHUNK_HEADER 5       // "1ff\r\n" - hex size line, padded in place
+#define PAGE_CHUNK_MAX_HEX 3      // Enough hex digits for PAGE_CHUNK_SIZE
+
+struct PageWriter {
+  WiFiClient &client;
+  char buf[PAGE_CHUNK_HEADER + PAGE_CHUNK_SIZE + 2];
+  int len;     // Payload bytes buffered
+  int total;   // Payload bytes sent so far
+  
+  PageWriter(WiFiClient &c) : client(c), len(0), total(0) {}
+  
+  // Emit the buffered payload as one chunk: size line, data and CRLF in a single write
+  void flush() {
+    if (len == 0) return;
+    char size[PAGE_CHUNK_MAX_HEX + 1];
+    int digits = snprintf(size, sizeof(size), "%x", len);
+    // Right-align the size line against the payload so the chunk is contiguous
+    char *start = buf + PAGE_CHUNK_HEADER - (digits + 2);
+    memcpy(start, size, digits);
+    start[digits] = '\r';
+    start[digits + 1] = '\n';
+    buf[PAGE_CHUNK_HEADER + len] = '\r';
+    buf[PAGE_CHUNK_HEADER + len + 1] = '\n';
+    client.write((const uint8_t *)start, (buf + PAGE_CHUNK_HEADER + len + 2) - start);
+    total += len;
+    len = 0;
+  }
+  
+  void write(const char *data, int n) {
+    while (n > 0) {
+      int room = PAGE_CHUNK_SIZE - len;
+      int take = n < room ? n : room;
+      memcpy(buf + PAGE_CHUNK_HEADER + len, data, take);
+      len += take;
+      data += take;
+      n -= take;
+      if (len == PAGE_CHUNK_SIZE) flush();
+    }
+  }
+  
+  void print(const char *s) {
+    write(s, strlen(s));
+  }
+  
+  // Formatted values are short; format straight into the buffer, flushing first if needed
+  void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char tmp[48];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+    if (n < 0) return;
+    if (n >= (int)sizeof(tmp)) n = sizeof(tmp) - 1;
+    write(tmp, n);
+  }
+  
+  // HTML-escape user-controlled text (SSIDs, passwords, names) for element and attribute content
+  void printEscaped(const char *s) {
+    const char *run = s;
+    for (; *s; s++) {
+      const char *entity = NULL;
+      switch (*s) {
+        case '&':  entity = "&amp;"; break;
+        case '<':  entity = "&lt;"; break;
+        case '>':  entity = "&gt;"; break;
+        case '\'': entity = "&#39;"; break;
+        case '"':  entity = "&quot;"; break;
+      }
+      if (entity) {
+        write(run, s - run);
+        print(entity);
+        run = s + 1;
+      }
+    }
+    write(run, s - run);
+  }
+  
+  // Flush and send the terminating zero-length chunk; returns the page size
+  int end() {
+    flush();
+    client.write((const uint8_t *)"0\r\n\r\n", 5);
+    client.flush();
+    return total;
+  }
+};
+
+// Template fields are written as {{name}}; the page's field function renders each one
+typedef void (*PageFieldFn)(PageWriter &out, const char *name, int nameLen);
+
+bool fieldIs(const char *name, int nameLen, const char *key) {
+  return (int)strlen(key) == nameLen && strncmp(name, key, nameLen) == 0;
+}
+
+// Stream a template: literal text is copied straight from flash, fields go through fieldFn
+int renderPage(WiFiClient &client, const char *tmpl, PageFieldFn fieldFn) {
+  sendHttpHeader(client, HTTP_CHUNKED, "text/html");
+  PageWriter out(client);
+  
+  const char *p = tmpl;
+  while (*p) {
+    const char *open = strstr(p, "{{");
+    if (open == NULL) {
+      out.print(p);
+      break;
+    }
+    out.write(p, open - p);
+    const char *close = strstr(open + 2, "}}");
+    if (close == NULL) {
+      out.print(open);
+      break;
+    }
+    if (fieldFn) {
+      fieldFn(out, open + 2, close - (open + 2));
+    }
+    p = close + 2;
+  }
+  
+  return out.end();
+}
+
+// Fields shared by the main and control page headers
+bool renderStatusField(PageWriter &out, const char *name, int nameLen) {
+  if (fieldIs(name, nameLen, "deviceId")) out.printEscaped(config.deviceId);
+  else if (fieldIs(name, nameLen, "mqttServer")) out.printEscaped(config.mqttServer);
+  else if (fieldIs(name, nameLen, "mqttClass")) out.print(mqttConnected ? "on" : "off");
+  else if (fieldIs(name, nameLen, "mqttState")) out.print(mqttConnected ? "CONNECTED" : "DISCONNECTED");
+  else return false;
+  return true;
+}
+
+const char MAIN_PAGE_TEMPLATE[] =
+  "<!DOCTYPE html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'><title>{{deviceId}}</title>"
+  "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:20px;background:#f5f5f7;max-width:500px;margin:0 auto;text-align:center}"
+  ".c{background:#fff;border-radius:12px;padding:30px;margin-bottom:12px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
+  "h1{margin:0 0 8px;font-size:24px;font-weight:600}"
+  ".s{font-size:13px;color:#666;margin-bottom:16px;display:flex;align-items:center;gap:8px;justify-content:center;flex-wrap:wrap}"
+  ".b{padding:4px 8px;border-radius:4px;font-size:11px;font-weight:600;white-space:nowrap}"
+  ".on{background:#34c759;color:#fff}.off{background:#ff3b30;color:#fff}"
+  "a{display:block;width:100%;padding:18px;border:none;border-radius:10px;text-align:center;font-weight:600;font-size:18px;cursor:pointer;margin:12px 0;text-decoration:none;transition:opacity 0.2s}"
+  "a:active{opacity:0.7}"
+  ".btn-b{background:#007aff;color:#fff}.btn-o{background:#ff9500;color:#fff}.ver{font-size:11px;color:#999;margin-top:16px}"
+  "</style></head><body>"
+  "<div class='c'><h1>{{deviceId}}</h1>"
+  "<div class='s'><span>MQTT:</span><span class='b {{mqttClass}}'>{{mqttState}}</span><span style='color:#999'>|</span><span style='color:#999'>{{mqttServer}}</span></div>"
+  "<a href='/control' class='btn-b'>CONTROL</a>"
+  "<a href='/telemetry' style='background:#5856d6;color:#fff'>TELEMETRY</a>"
+  "<a href='/setup' class='btn-o'>SETUP</a>"
+  "<div class='ver'>v{{version}}</div>"
+  "</div></body></html>";
+
+void mainPageField(PageWriter &out, const char *name, int nameLen) {
+  if (renderStatusField(out, name, nameLen)) return;
+  if (fieldIs(name, nameLen, "version")) out.print(FIRMWARE_VERSION);
+}
+
+void sendMainPage(WiFiClient &client) {
+  PROFILE_SPAN(PROF_PAGE_MAIN);
+  LOG_DEBUG("Sending main page");
+  int bodyLen = renderPage(client, MAIN_PAGE_TEMPLATE, mainPageField);
+  LOG_DEBUG("Main page HTML size: %d", bodyLen);
+  LOG_DEBUG("Main page sent!");
+}
+
+const char CONTROL_PAGE_TEMPLATE[] =
+  "<!DOCTYPE html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'><title>Control - {{deviceId}}</title>"
+  "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:10px;background:#f5f5f7;max-width:500px;margin:0 auto}"
+  ".c{background:#fff;border-radius:12px;padding:16px;margin-bottom:12px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
+  "h2{margin:0 0 8px;font-size:20px;font-weight:600}"
+  ".s{font-size:13px;color:#666;margin-bottom:4px;display:flex;align-items:center;gap:8px;flex-wrap:wrap}"
+  ".b{padding:4px 8px;border-radius:4px;font-size:11px;font-weight:600;white-space:nowrap}"
+  ".on{background:#34c759;color:#fff}.off{background:#ff3b30;color:#fff}"
+  ".row{display:flex;gap:8px;margin:8px 0}"
+  "form{flex:1;margin:0}"
+  "button,a{display:block;width:100%;padding:14px;border:none;border-radius:10px;text-align:center;font-weight:600;font-size:16px;cursor:pointer;transition:opacity 0.2s;-webkit-tap-highlight-color:transparent;text-decoration:none;margin:0}"
+  "button:active,a:active{opacity:0.7}"
+  ".g{background:#007aff;color:#fff}.r{background:#8e8e93;color:#fff}.u{background:#007aff;color:#fff}.gray{background:#8e8e93;color:#fff}"
+  "@media(min-width:400px){body{padding:15px}.c{padding:20px}button,a{font-size:15px}}"
+  "</style></head><body>"
+  "<div class='c'><h2>{{deviceId}}</h2>"
+  "<div class='s'><span>MQTT:</span><span class='b {{mqttClass}}'>{{mqttState}}</span><span style='color:#999'>|</span><span style='color:#999'>{{mqttServer}}</span></div>"
+  "<div class='s'><span>Watchdog:</span><span class='b {{watchdogClass}}'>{{watchdogState}}</span>{{watchdogDetail}}</div></div>"
+  "<div class='c'>"
+  "<div class='row'><form action='/led' method='GET'><input type='hidden' name='state' value='on'><button class='g'>LED ON</button></form>"
+  "<form action='/led' method='GET'><input type='hidden' name='state' value='off'><button class='r'>LED OFF</button></form></div>"
+  "<div class='row'><form action='/display' method='GET'><input type='hidden' name='state' value='on'><button class='g'>Display ON</button></form>"
+  "<form action='/display' method='GET'><input type='hidden' name='state' value='off'><button class='r'>Display OFF</button></form></div>"
+  "<div class='row'><form action='/wifiled' method='GET'><input type='hidden' name='state' value='on'><button class='g'>WiFi LED ON</button></form>"
+  "<form action='/wifiled' method='GET'><input type='hidden' name='state' value='off'><button class='r'>WiFi LED OFF</button></form></div>"
+  "<div class='row'><form action='/azureled' method='GET'><input type='hidden' name='state' value='on'><button class='g'>Azure LED ON</button></form>"
+  "<form action='/azureled' method='GET'><input type='hidden' name='state' value='off'><button class='r'>Azure LED OFF</button></form></div>"
+  "<div class='row'><form action='/userled' method='GET'><input type='hidden' name='state' value='on'><button class='g'>User LED ON</button></form>"
+  "<form action='/userled' method='GET'><input type='hidden' name='state' value='off'><button class='r'>User LED OFF</button></form></div>"
+  "<div class='row'><form action='/watchdog' method='GET'><input type='hidden' name='state' value='enable'><button class='g'>Watchdog ON</button></form>"
+  "<form action='/watchdog' method='GET'><input type='hidden' name='state' value='disable'><button class='r'>Watchdog OFF</button></form></div>"
+  "<form action='/reset' method='GET' style='margin:16px 0 8px'><button class='u'>RESET</button></form>"
+  "<a href='/' class='gray'>BACK</a>"
+  "</div></body></html>";
+
+void controlPageField(PageWriter &out, const char *name, int nameLen) {
+  if (renderStatusField(out, name, nameLen)) return;
+  if (fieldIs(name, nameLen, "watchdogClass")) {
+    out.print(watchdogEnabled ? "on" : "off");
+  } else if (fieldIs(name, nameLen, "watchdogState")) {
+    out.print(watchdogEnabled ? "ENABLED" : "DISABLED");
+  } else if (fieldIs(name, nameLen, "watchdogDetail")) {
+    // Calculate time since last network activity for watchdog display
+    unsigned long timeSinceActivity = (millis() - lastSuccessfulNetworkActivity) / 1000; // seconds
+    RuntimeSettings settings;
+    settingsRead(settings);
+    if (watchdogEnabled && timeSinceActivity < settings.watchdogTimeout) {
+      out.print("<span style='color:#999'> | </span><span style='color:#999'>OK</span>");
+    }
+  }
+}
+
+void sendControlPage(WiFiClient &client) {
+  PROFILE_SPAN(PROF_PAGE_CONTROL);
+  LOG_DEBUG("Sending control page");
+  int bodyLen = renderPage(client, CONTROL_PAGE_TEMPLATE, controlPageField);
+  LOG_DEBUG("Control page HTML size: %d", bodyLen);
+  LOG_DEBUG("Control page sent!");
+}
+
+const char TELEMETRY_PAGE_TEMPLATE[] =
+  "<!DOCTYPE html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'><title>Telemetry - {{deviceId}}</title>"
+  "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:10px;background:#f5f5f7;max-width:500px;margin:0 auto}"
+  ".c{background:#fff;border-radius:12px;padding:16px;margin-bottom:12px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
+  "h2{margin:0 0 12px;font-size:20px;font-weight:600}"
+  "h3{margin:16px 0 8px;font-size:16px;font-weight:600;color:#666}"
+  ".row{display:flex;justify-content:space-between;padding:8px 0;border-bottom:1px solid #f0f0f0}"
+  ".row:last-child{border-bottom:none}"
+  ".label{font-weight:600;color:#333}"
+  ".value{color:#666}"
+  ".s{font-size:12px;color:#999;margin-top:12px;text-align:center}"
+  "a{display:block;width:100%;padding:14px;border:none;border-radius:10px;text-align:center;font-weight:600;font-size:16px;cursor:pointer;transition:opacity 0.2s;text-decoration:none;margin-top:12px}"
+  "a:active{opacity:0.7}"
+  ".gray{background:#8e8e93;color:#fff}"
+  "</style></head><body>"
+  "<div class='c'><h2>Telemetry Data</h2>"
+  "<h3>Environment</h3>"
+  "<div class='row'><span class='label'>Temperature</span><span class='value'><span id='temperature'>{{temperature}}</span> C</span></div>"
+  "<div class='row'><span class='label'>Humidity</span><span class='value'><span id='humidity'>{{humidity}}</span> %</span></div>"
+  "<div class='row'><span class='label'>Pressure</span><span class='value'><span id='pressure'>{{pressure}}</span> mbar</span></div>"
+  "<h3>Accelerometer</h3>"
+  "<div class='row'><span class='label'>X-axis</span><span class='value'><span id='ax'>{{ax}}</span> g</span></div>"
+  "<div class='row'><span class='label'>Y-axis</span><span class='value'><span id='ay'>{{ay}}</span> g</span></div>"
+  "<div class='row'><span class='label'>Z-axis</span><span class='value'><span id='az'>{{az}}</span> g</span></div>"
+  "<h3>Gyroscope</h3>"
+  "<div class='row'><span class='label'>X-axis</span><span class='value'><span id='gx'>{{gx}}</span> dps</span></div>"
+  "<div class='row'><span class='label'>Y-axis</span><span class='value'><span id='gy'>{{gy}}</span> dps</span></div>"
+  "<div class='row'><span class='label'>Z-axis</span><span class='value'><span id='gz'>{{gz}}</span> dps</span></div>"
+  "<h3>Magnetometer</h3>"
+  "<div class='row'><span class='label'>X-axis</span><span class='value'><span id='mx'>{{mx}}</span> G</span></div>"
+  "<div class='row'><span class='label'>Y-axis</span><span class='value'><span id='my'>{{my}}</span> G</span></div>"
+  "<div class='row'><span class='label'>Z-axis</span><span class='value'><span id='mz'>{{mz}}</span> G</span></div>"
+  "<div class='s' id='live'>Live updates: connecting...</div>"
+  "</div>"
+  "</div>"
+  "<div class='c'><h3 style='margin-top:0'>History</h3>"
+  "<select id='hc' onchange='hist()'><option>temperature</option><option>humidity</option><option>pressure</option></select>"
+  "<svg id='hg' viewBox='0 0 300 100' preserveAspectRatio='none' style='display:block;width:100%;height:120px;margin-top:8px;background:#fafafa;border-radius:8px'>"
+  "<polyline fill='none' stroke='#007aff' stroke-width='1.5' vector-effect='non-scaling-stroke'/></svg>"
+  "<div class='s' id='hr'>Loading...</div>"
+  "</div>"
+  "<a href='/' class='gray'>BACK</a>"
+  "<script>var l=document.getElementById('live');if(window.EventSource){var es=new EventSource('/events');"
+  "es.onopen=function(){l.textContent='Live updates: on'};"
+  "es.onerror=function(){l.textContent='Live updates: reconnecting...'};"
+  "es.onmessage=function(e){var d=JSON.parse(e.data);for(var k in d){var el=document.getElementById(k);if(el)el.textContent=d[k]}}"
+  "}else{l.textContent='Live updates: not supported'}</script>"
+  // Chart is drawn from the downsampled /api/history, so its size doesn't grow with the stored range
+  "<script>function hist(){var c=document.getElementById('hc').value;"
+  "fetch('/api/history?channel='+c+'&points=150').then(function(r){return r.json()}).then(function(d){"
+  "var p=d.points,r=document.getElementById('hr'),g=document.querySelector('#hg polyline');"
+  "if(p.length<2){r.textContent='No history yet';g.setAttribute('points','');return}"
+  "var t0=p[0][0],t1=p[p.length-1][0],lo=p[0][1],hi=lo,s='';"
+  "p.forEach(function(q){lo=Math.min(lo,q[1]);hi=Math.max(hi,q[1])});"
+  "p.forEach(function(q){s+=(300*(q[0]-t0)/(t1-t0||1)).toFixed(1)+','+(95-90*(q[1]-lo)/(hi-lo||1)).toFixed(1)+' '});"
+  "g.setAttribute('points',s);r.textContent=lo+' to '+hi+' over the last '+((t1-t0)/3600).toFixed(1)+' h'})"
+  ".catch(function(){document.getElementById('hr').textContent='History unavailable'})}"
+  "hist();setInterval(hist,300000)</script>"
+  "</body></html>";
+
+void telemetryPageField(PageWriter &out, const char *name, int nameLen) {
+  if (fieldIs(name, nameLen, "deviceId")) {
+    out.printEscaped(config.deviceId);
+    return;
+  }
+  // Sensor fields share their names (and precision) with the /events stream
+  for (int i = 0; i < SSE_FIELD_COUNT; i++) {
+    if (fieldIs(name, nameLen, sseFields[i].key)) {
+      out.printf("%.*f", sseFields[i].decimals, *sseFields[i].value);
+      return;
+    }
+  }
+}
+
+void sendTelemetryPage(WiFiClient &client) {
+  PROFILE_SPAN(PROF_PAGE_TELEMETRY);
+  LOG_DEBUG("Sending telemetry page");
+  int bodyLen = renderPage(client, TELEMETRY_PAGE_TEMPLATE, telemetryPageField);
+  LOG_DEBUG("Telemetry page HTML size: %d", bodyLen);
+  LOG_DEBUG("Telemetry page sent!");
+}
+
+const char SETUP_PAGE_TEMPLATE[] =
+  "<!DOCTYPE html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'><title>Setup - {{deviceId}}</title>"
+  "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:10px;background:#f5f5f7;max-width:500px;margin:0 auto}"
+  ".c{background:#fff;border-radius:12px;padding:16px;margin-bottom:12px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
+  "h2{margin:0 0 12px;font-size:20px;font-weight:600}"
+  "label{display:block;font-size:13px;font-weight:600;color:#333;margin:12px 0 4px}"
+  "input{width:100%;padding:10px;border:1px solid #ddd;border-radius:8px;font-size:15px}"
+  "input:focus{outline:none;border-color:#007aff}"
+  "button,a{display:block;width:100%;padding:14px;border:none;border-radius:10px;text-align:center;font-weight:600;font-size:16px;cursor:pointer;transition:opacity 0.2s;-webkit-tap-highlight-color:transparent;text-decoration:none;margin-top:12px}"
+  "button:active,a:active{opacity:0.7}"
+  ".g{background:#34c759;color:#fff}.gray{background:#8e8e93;color:#fff}"
+  ".note{font-size:12px;color:#999;margin-top:8px}"
+  "@media(min-width:400px){body{padding:15px}.c{padding:20px}}"
+  "</style></head><body>"
+  "<div class='c'><h2>Device Setup</h2>"
+  "<form action='/save-config' method='GET'>"
+  "<label>Device ID</label><input name='deviceId' value='{{deviceId}}' maxlength='31'>"
+  "<label>Model</label><input name='model' value='{{model}}' maxlength='15'>"
+  "<label>Location</label><input name='location' value='{{location}}' maxlength='31'>"
+  "<label>WiFi SSID</label><input name='ssid' value='{{ssid}}' maxlength='31'>"
+  "<label>WiFi Password</label><input name='password' type='password' value='{{password}}' maxlength='63'>"
+  "<label>MQTT Server</label><input name='mqttServer' value='{{mqttServer}}' maxlength='63'>"
+  "<label>MQTT Port</label><input name='mqttPort' type='number' value='{{mqttPort}}' min='1' max='65535'>"
+  "<label>MQTT Topic</label><input name='mqttTopic' value='{{mqttTopic}}' maxlength='63'>"
+  "<label>Syslog Host (IPv4, empty = off)</label><input name='syslogHost' value='{{syslogHost}}' maxlength='15'>"
+  "<label>Syslog Port</label><input name='syslogPort' type='number' value='{{syslogPort}}' min='1' max='65535'>"
+  "<button class='g'>SAVE & REBOOT</button>"
+  "</form>"
+  "<p class='note'>Saving will write configuration to Flash memory and reboot the device.</p>"
+  "<a href='/' class='gray'>CANCEL</a>"
+  "</div></body></html>";
+
+void setupPageField(PageWriter &out, const char *name, int nameLen) {
+  if (fieldIs(name, nameLen, "deviceId")) out.printEscaped(config.deviceId);
+  else if (fieldIs(name, nameLen, "model")) out.printEscaped(config.model);
+  else if (fieldIs(name, nameLen, "location")) out.printEscaped(config.location);
+  else if (fieldIs(name, nameLen, "ssid")) out.printEscaped(config.ssid);
+  else if (fieldIs(name, nameLen, "password")) out.printEscaped(config.password);
+  else if (fieldIs(name, nameLen, "mqttServer")) out.printEscaped(config.mqttServer);
+  else if (fieldIs(name, nameLen, "mqttPort")) out.printf("%d", config.mqttPort);
+  else if (fieldIs(name, nameLen, "mqttTopic")) out.printEscaped(config.mqttTopic);
+  else if (fieldIs(name, nameLen, "syslogHost")) out.printEscaped(config.syslogHost);
+  else if (fieldIs(name, nameLen, "syslogPort")) out.printf("%d", config.syslogPort);
+}
+
+void sendSetupPage(WiFiClient &client) {
+  PROFILE_SPAN(PROF_PAGE_SETUP);
+  unsigned long sendStart = millis();
+  LOG_DEBUG("Sending setup page at %lu", sendStart);
+  int bodyLen = renderPage(client, SETUP_PAGE_TEMPLATE, setupPageField);
+  LOG_DEBUG("Setup page HTML size: %d", bodyLen);
+  LOG_DEBUG("Setup page sent!");
+}
+
+const char SUCCESS_PAGE_TEMPLATE[] =
+  "<!DOCTYPE html><html><head><meta http-equiv='refresh' content='2;url=/'><meta name='viewport' content='width=device-width,initial-scale=1'><title>Saved</title>"
+  "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:20px;background:#f5f5f7;max-width:500px;margin:0 auto;text-align:center}"
+  ".c{background:#fff;border-radius:12px;padding:30px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
+  "h2{color:#34c759;margin:0 0 12px}"
+  "p{color:#666;margin:0}"
+  "</style></head><body>"
+  "<div class='c'><h2>Configuration Saved!</h2>"
+  "<p>Redirecting to home...</p></div></body></html>";
+
+void sendSuccessPage(WiFiClient &client) {
+  PROFILE_SPAN(PROF_PAGE_SUCCESS);
+  int bodyLen = renderPage(client, SUCCESS_PAGE_TEMPLATE, NULL);
+  LOG_DEBUG("Success page HTML size: %d", bodyLen);
+}
+
+// URL decode helper function
+void urlDecode(char* dst, const char* src, int srcLen, int maxLen) {
+  int i = 0, j = 0;
+  while (i < srcLen && j < maxLen - 1) {
+    if (src[i] == '%' && i + 2 < srcLen) {
+      char hex[3] = {src[i+1], src[i+2], 0};
+      dst[j++] = (char)strtol(hex, NULL, 16);
+      i += 3;
+    } else if (src[i] == '+') {
+      dst[j++] = ' ';
+      i++;
+    } else {
+      dst[j++] = src[i++];
+    }
+  }
+  dst[j] = 0;
+}
+
+// Parse query parameter helper - query is the text after '?', e.g. "state=on&x=1"
+bool getQueryParam(const char* query, const char* param, char* value, int maxLen) {
+  int paramLen = strlen(param);
+  const char *p = query;
+  while (*p) {
+    const char *end = strchr(p, '&');
+    if (end == NULL) end = p + strlen(p);
+    if (end - p > paramLen && strncmp(p, param, paramLen) == 0 && p[paramLen] == '=') {
+      const char *val = p + paramLen + 1;
+      urlDecode(value, val, end - val, maxLen);
+      return true;
+    }
+    p = *end ? end + 1 : end;
+  }
+  return false;
+}
+
+// Server-Sent Events (/events) - pushes telemetry to browsers over one long-lived connection
+// Each subscriber gets its own send buffer that the web thread drains a little at a time,
+// so a slow browser only ever delays itself.
+#define SSE_MAX_CLIENTS         3        // Bounded subscriber count
+#define SSE_BUFFER_SIZE         512      // Per-client pending output
+#define SSE_WRITE_CHUNK         128      // Max bytes written to one client per pass
+#define SSE_KEEPALIVE_INTERVAL  15000    // Comment line to keep proxies/browsers from timing out
+#define SSE_STALL_TIMEOUT       20000    // Drop a client that accepts no data for this long
+
+struct SseClient {
+  WiFiClient client;
+  bool active;
+  bool needsSnapshot;       // Missed a delta (buffer full) - send all fields next time
+  char buffer[SSE_BUFFER_SIZE];
+  int sent;                 // Bytes of buffer already written
+  int len;                  // Bytes of buffer in use
+  unsigned long lastProgress;
+  unsigned long lastKeepalive;
+};
+
+SseClient sseClients[SSE_MAX_CLIENTS];
+uint32_t sseLastSeq = 0;
+unsigned long sseDroppedEvents = 0;
+unsigned long sseRejectedClients = 0;
+
+// Last value broadcast per field, kept as formatted text so "changed" means visibly changed
+char sseLastText[SSE_FIELD_COUNT][12];
+
+int sseActiveCount() {
+  int n = 0;
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (sseClients[i].active) n++;
+  }
+  return n;
+}
+
+// Build "data: {...}\n\n" with either all fields or only those that differ from sseLastText
+int sseFormatEvent(char *out, int outSize, bool full) {
+  int pos = snprintf(out, outSize, "data: {");
+  bool first = true;
+  for (int i = 0; i < SSE_FIELD_COUNT && pos < outSize; i++) {
+    char text[12];
+    snprintf(text, sizeof(text), "%.*f", sseFields[i].decimals, *sseFields[i].value);
+    if (!full && strcmp(text, sseLastText[i]) == 0) continue;
+    pos += snprintf(out + pos, outSize - pos, "%s\"%s\":\"%s\"", first ? "" : ",", sseFields[i].key, text);
+    first = false;
+  }
+  if (first) return 0;  // Nothing changed
+  if (pos < outSize) {
+    pos += snprintf(out + pos, outSize - pos, "}\n\n");
+  }
+  return pos < outSize ? pos : 0;
+}
+
+// Append to a client's send buffer; returns false (and leaves the buffer untouched) if it won't fit
+bool sseEnqueue(SseClient &sc, const char *data, int dataLen) {
+  if (sc.sent > 0) {
+    // Compact already-sent bytes out of the buffer
+    memmove(sc.buffer, sc.buffer + sc.sent, sc.len - sc.sent);
+    sc.len -= sc.sent;
+    sc.sent = 0;
+  }
+  if (sc.len + dataLen > SSE_BUFFER_SIZE) {
+    return false;
+  }
+  memcpy(sc.buffer + sc.len, data, dataLen);
+  sc.len += dataLen;
+  return true;
+}
+
+void sseClose(SseClient &sc, const char *reason) {
+  LOG_INFO("SSE client closed: %s", reason);
+  sc.client.stop();
+  sc.active = false;
+}
+
+// Take over an accepted /events connection; the caller must not stop() the client afterwards
+void sseSubscribe(WiFiClient &client) {
+  streamMutex.lock();
+  SseClient *slot = NULL;
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (!sseClients[i].active) {
+      slot = &sseClients[i];
+      break;
+    }
+  }
+
+  if (slot == NULL) {
+    streamMutex.unlock();
+    sseRejectedClients++;
+    LOG_INFO("SSE subscriber limit reached, rejecting");
+    httpSendUnavailable(client);
+    return;
+  }
+
+  const char *header =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "retry: 5000\n\n";
+  client.write((const uint8_t *)header, strlen(header));
+
+  slot->client = client;
+  slot->active = true;
+  slot->needsSnapshot = true;  // First event carries every field
+  slot->sent = 0;
+  slot->len = 0;
+  slot->lastProgress = millis();
+  slot->lastKeepalive = millis();
+
+  int active = sseActiveCount();
+  streamMutex.unlock();
+
+  LOG_INFO("SSE client subscribed (%d/%d)", active, SSE_MAX_CLIENTS);
+}
+
+// Called every pass of the web thread: queue new samples, then drain a bounded amount per client
+void serviceSseClients() {
+  streamMutex.lock();
+  if (sseActiveCount() == 0) {
+    sseLastSeq = telemetrySeq;
+    streamMutex.unlock();
+    return;
+  }
+
+  unsigned long now = millis();
+  uint32_t seq = telemetrySeq;
+  bool newSample = (seq != sseLastSeq);
+
+  char delta[SSE_BUFFER_SIZE];
+  int deltaLen = newSample ? sseFormatEvent(delta, sizeof(delta), false) : 0;
+
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    SseClient &sc = sseClients[i];
+    if (!sc.active) continue;
+
+    if (!sc.client.connected()) {
+      sseClose(sc, "disconnected");
+      continue;
+    }
+
+    if (sc.needsSnapshot) {
+      char full[SSE_BUFFER_SIZE];
+      int fullLen = sseFormatEvent(full, sizeof(full), true);
+      if (fullLen > 0 && sseEnqueue(sc, full, fullLen)) {
+        sc.needsSnapshot = false;
+      }
+    } else if (deltaLen > 0) {
+      if (!sseEnqueue(sc, delta, deltaLen)) {
+        // Client is behind - drop this delta and resync with a full snapshot once it drains
+        sseDroppedEvents++;
+        sc.needsSnapshot = true;
+      }
+    }
+
+    if (sc.len == sc.sent && now - sc.lastKeepalive > SSE_KEEPALIVE_INTERVAL) {
+      sseEnqueue(sc, ": keepalive\n\n", 13);
+    }
+
+    if (sc.len > sc.sent) {
+      int chunk = sc.len - sc.sent;
+      if (chunk > SSE_WRITE_CHUNK) chunk = SSE_WRITE_CHUNK;
+      int written = sc.client.write((const uint8_t *)sc.buffer + sc.sent, chunk);
+      if (written > 0) {
+        sc.sent += written;
+        sc.lastProgress = now;
+        sc.lastKeepalive = now;
+        if (sc.sent == sc.len) {
+          sc.sent = 0;
+          sc.len = 0;
+        }
+      } else if (now - sc.lastProgress > SSE_STALL_TIMEOUT) {
+        sseClose(sc, "stalled");
+      }
+    } else {
+      sc.lastProgress = now;
+    }
+  }
+
+  if (newSample) {
+    // Remember what was broadcast so the next event only carries changed fields
+    for (int i = 0; i < SSE_FIELD_COUNT; i++) {
+      snprintf(sseLastText[i], sizeof(sseLastText[i]), "%.*f", sseFields[i].decimals, *sseFields[i].value);
+    }
+    sseLastSeq = seq;
+  }
+  streamMutex.unlock();
+}
+
+// WebSocket IMU stream (/imu) - accelerometer/gyro at full rate for commissioning
+// A dedicated thread samples the LSM6DSL into a ring buffer; the web thread batches samples into
+// binary frames. When the client or WiFi can't keep up the ring fills and the sampler decimates.
+#define IMU_STREAM_ODR_HZ       208      // LSM6DSL output data rate while streaming
+#define IMU_STREAM_PERIOD_MS    5        // Sampler period (~200 Hz)
+#define IMU_RING_SIZE           512      // Samples, power of two
+#define IMU_FRAME_SAMPLES       20       // Samples per binary frame
+#define IMU_MAX_DECIMATION      16
+#define IMU_FRAMES_PER_PASS     2        // Bound on frames written per web-thread pass
+#define IMU_STALL_TIMEOUT       5000
+
+// One sample on the wire: little-endian int16 accel (mg) and gyro (0.1 dps)
+struct ImuSample {
+  int16_t ax, ay, az;
+  int16_t gx, gy, gz;
+} __attribute__((packed));
+
+// Frame header: seq (u32), first sample index (u32), sample count (u16), decimation (u16),
+// dropped frames so far (u32), followed by sampleCount ImuSamples
+#define IMU_FRAME_HEADER_SIZE   16
+
+rtos::Thread *imuThread_ptr = NULL;
+rtos::Mutex sensorBusMutex;  // Serialises sensor I2C access between loop() and the IMU sampler
+
+ImuSample imuRing[IMU_RING_SIZE];
+volatile uint32_t imuHead = 0;         // Written by sampler
+volatile uint32_t imuTail = 0;         // Written by web thread
+volatile bool imuStreamActive = false;
+volatile uint16_t imuDecimation = 1;
+
+WiFiClient imuWsClient;
+uint32_t imuFrameSeq = 0;
+unsigned long imuLastProgress = 0;
+unsigned long imuFramesSent = 0;
+unsigned long imuDroppedFrames = 0;
+volatile unsigned long imuDroppedSamples = 0;
+unsigned long imuRateWindowStart = 0;
+unsigned long imuRateWindowSamples = 0;
+float imuAchievedRate = 0.0;
+
+// SHA-1 (RFC 3174) - only used for the WebSocket handshake
+void sha1(const uint8_t *data, size_t len, uint8_t digest[20]) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  uint8_t block[64];
+  uint64_t bitLen = (uint64_t)len * 8;
+  size_t total = ((len + 8) / 64 + 1) * 64;
+
+  for (size_t offset = 0; offset < total; offset += 64) {
+    for (int i = 0; i < 64; i++) {
+      size_t idx = offset + i;
+      if (idx < len) block[i] = data[idx];
+      else if (idx == len) block[i] = 0x80;
+      else if (idx >= total - 8) block[i] = (uint8_t)(bitLen >> (8 * (total - 1 - idx)));
+      else block[i] = 0;
+    }
+
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+             ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+      uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+      w[i] = (x << 1) | (x >> 31);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+      else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+      else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+      else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+      uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+      e = d; d = c; c = (b << 30) | (b >> 2); b = a; a = temp;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+
+  for (int i = 0; i < 20; i++) {
+    digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+  }
+}
+
+int base64Encode(const uint8_t *in, int len, char *out, int outSize) {
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  int pos = 0;
+  for (int i = 0; i < len && pos + 4 < outSize; i += 3) {
+    uint32_t v = (uint32_t)in[i] << 16;
+    if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+    if (i + 2 < len) v |= in[i + 2];
+    out[pos++] = table[(v >> 18) & 0x3F];
+    out[pos++] = table[(v >> 12) & 0x3F];
+    out[pos++] = (i + 1 < len) ? table[(v >> 6) & 0x3F] : '=';
+    out[pos++] = (i + 2 < len) ? table[v & 0x3F] : '=';
+  }
+  out[pos] = 0;
+  return pos;
+}
+
+// Sampler thread: reads the IMU at IMU_STREAM_PERIOD_MS while a client is connected
+void imuThreadFunc() {
+  uint32_t sampleIndex = 0;
+
+  while (1) {
+    if (!imuStreamActive) {
+      Thread::wait(100);
+      continue;
+    }
+
+    unsigned long next = millis();
+    while (imuStreamActive) {
+      int axes[3], gyro[3];
+      sensorBusMutex.lock();
+      acc_gyro->getXAxes(axes);
+      acc_gyro->getGAxes(gyro);
+      sensorBusMutex.unlock();
+
+      // Decimate at the source when the consumer is behind
+      if (sampleIndex++ % imuDecimation == 0) {
+        uint32_t head = imuHead;
+        if (head - imuTail >= IMU_RING_SIZE) {
+          imuDroppedSamples++;
+        } else {
+          ImuSample &s = imuRing[head & (IMU_RING_SIZE - 1)];
+          s.ax = axes[0];
+          s.ay = axes[1];
+          s.az = axes[2];
+          s.gx = gyro[0] / 100;  // mdps -> 0.1 dps
+          s.gy = gyro[1] / 100;
+          s.gz = gyro[2] / 100;
+          imuHead = head + 1;
+        }
+      }
+
+      next += IMU_STREAM_PERIOD_MS;
+      long remaining = (long)(next - millis());
+      if (remaining > 0) {
+        Thread::wait(remaining);
+      } else {
+        next = millis();  // Fell behind (bus contention) - don't try to catch up in a burst
+        Thread::yield();
+      }
+    }
+  }
+}
+
+// Write a single unmasked WebSocket frame (server -> client)
+bool wsSendFrame(WiFiClient &client, uint8_t opcode, const uint8_t *payload, int len) {
+  uint8_t header[4];
+  int headerLen = 0;
+  header[headerLen++] = 0x80 | opcode;  // FIN + opcode
+  if (len < 126) {
+    header[headerLen++] = len;
+  } else {
+    header[headerLen++] = 126;
+    header[headerLen++] = (len >> 8) & 0xFF;
+    header[headerLen++] = len & 0xFF;
+  }
+  if (client.write(header, headerLen) != (size_t)headerLen) return false;
+  if (len > 0 && client.write(payload, len) != (size_t)len) return false;
+  return true;
+}
+
+void imuStreamStop(const char *reason) {
+  LOG_INFO("IMU stream stopped: %s", reason);
+  imuStreamActive = false;
+  imuWsClient.stop();
+  imuAchievedRate = 0.0;
+}
+
+// Complete the WebSocket handshake and hand the connection to the streamer
+void imuStreamAccept(WiFiClient &client, const char *wsKey) {
+  streamMutex.lock();
+  if (imuStreamActive) {
+    streamMutex.unlock();
+    LOG_INFO("IMU stream already in use, rejecting");
+    httpSendUnavailable(client);
+    return;
+  }
+
+  // Sec-WebSocket-Accept = base64(sha1(key + GUID))
+  char keyBuf[96];
+  int keyLen = snprintf(keyBuf, sizeof(keyBuf), "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11", wsKey);
+  uint8_t digest[20];
+  sha1((const uint8_t *)keyBuf, keyLen, digest);
+  char accept[32];
+  base64Encode(digest, sizeof(digest), accept, sizeof(accept));
+
+  char header[192];
+  int headerLen = snprintf(header, sizeof(header),
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: %s\r\n"
+    "\r\n",
+    accept);
+  client.write((const uint8_t *)header, headerLen);
+
+  sensorBusMutex.lock();
+  acc_gyro->setXOdr(IMU_STREAM_ODR_HZ);
+  acc_gyro->setGOdr(IMU_STREAM_ODR_HZ);
+  sensorBusMutex.unlock();
+
+  imuWsClient = client;
+  imuTail = imuHead;
+  imuDecimation = 1;
+  imuFrameSeq = 0;
+  imuLastProgress = millis();
+  imuRateWindowStart = millis();
+  imuRateWindowSamples = 0;
+  imuStreamActive = true;
+  streamMutex.unlock();
+  LOG_INFO("IMU WebSocket stream started");
+}
+
+// Handle control frames from the browser (close/ping); payloads are small and masked
+void imuHandleIncoming() {
+  while (imuWsClient.available() >= 2) {
+    uint8_t h[2];
+    imuWsClient.read(h, 2);
+    uint8_t opcode = h[0] & 0x0F;
+    int len = h[1] & 0x7F;
+    if (len > 125) {
+      imuStreamStop("oversized client frame");
+      return;
+    }
+    uint8_t mask[4] = {0, 0, 0, 0};
+    if (h[1] & 0x80) imuWsClient.read(mask, 4);
+    uint8_t payload[125];
+    int got = len > 0 ? imuWsClient.read(payload, len) : 0;
+    for (int i = 0; i < got; i++) payload[i] ^= mask[i % 4];
+
+    if (opcode == 0x8) {
+      wsSendFrame(imuWsClient, 0x8, payload, got);
+      imuStreamStop("client closed");
+      return;
+    } else if (opcode == 0x9) {
+      wsSendFrame(imuWsClient, 0xA, payload, got);  // Pong
+    }
+  }
+}
+
+// One streaming pass; caller holds streamMutex
+void serviceImuStreamLocked() {
+  unsigned long now = millis();
+  if (!imuWsClient.connected()) {
+    imuStreamStop("disconnected");
+    return;
+  }
+  imuHandleIncoming();
+  if (!imuStreamActive) return;
+
+  for (int f = 0; f < IMU_FRAMES_PER_PASS; f++) {
+    uint32_t tail = imuTail;
+    uint32_t available = imuHead - tail;
+    if (available < IMU_FRAME_SAMPLES) break;
+
+    uint8_t frame[IMU_FRAME_HEADER_SIZE + IMU_FRAME_SAMPLES * sizeof(ImuSample)];
+    uint32_t dropped = imuDroppedFrames + imuDroppedSamples / IMU_FRAME_SAMPLES;
+    uint16_t count = IMU_FRAME_SAMPLES;
+    uint16_t decimation = imuDecimation;
+    memcpy(frame, &imuFrameSeq, 4);
+    memcpy(frame + 4, &tail, 4);
+    memcpy(frame + 8, &count, 2);
+    memcpy(frame + 10, &decimation, 2);
+    memcpy(frame + 12, &dropped, 4);
+    for (int i = 0; i < IMU_FRAME_SAMPLES; i++) {
+      memcpy(frame + IMU_FRAME_HEADER_SIZE + i * sizeof(ImuSample),
+             &imuRing[(tail + i) & (IMU_RING_SIZE - 1)], sizeof(ImuSample));
+    }
+
+    if (!wsSendFrame(imuWsClient, 0x2, frame, sizeof(frame))) {
+      // Partial write - frame is lost, stream resumes with the next one
+      imuDroppedFrames++;
+      if (now - imuLastProgress > IMU_STALL_TIMEOUT) {
+        imuStreamStop("stalled");
+        return;
+      }
+      break;
+    }
+    imuTail = tail + IMU_FRAME_SAMPLES;
+    imuFrameSeq++;
+    imuFramesSent++;
+    imuRateWindowSamples += IMU_FRAME_SAMPLES;
+    imuLastProgress = now;
+  }
+
+  // Backpressure: halve the rate when the ring is 3/4 full, restore it once nearly drained
+  uint32_t fill = imuHead - imuTail;
+  if (fill > IMU_RING_SIZE * 3 / 4 && imuDecimation < IMU_MAX_DECIMATION) {
+    imuDecimation *= 2;
+    LOG_INFO("IMU stream falling behind, decimation now %u", (unsigned)imuDecimation);
+  } else if (fill < IMU_FRAME_SAMPLES && imuDecimation > 1) {
+    imuDecimation /= 2;
+  }
+
+  if (now - imuRateWindowStart >= 1000) {
+    imuAchievedRate = imuRateWindowSamples * 1000.0f / (now - imuRateWindowStart);
+    imuRateWindowStart = now;
+    imuRateWindowSamples = 0;
+  }
+}
+
+// Called every pass of the web thread while a stream is active
+void serviceImuStream() {
+  if (!imuStreamActive) return;
+  
+  streamMutex.lock();
+  serviceImuStreamLocked();
+  streamMutex.unlock();
+}
+
+// JSON stream statistics for /api/imu
+void sendImuStats(WiFiClient &client) {
+  char body[320];
+  int bodyLen = snprintf(body, sizeof(body),
+    "{\"streaming\":%s,\"odr_hz\":%d,\"decimation\":%u,\"achieved_hz\":%.1f,"
+    "\"frames_sent\":%lu,\"dropped_frames\":%lu,\"dropped_samples\":%lu,\"ring_fill\":%lu}",
+    imuStreamActive ? "true" : "false", IMU_STREAM_ODR_HZ, (unsigned)imuDecimation, imuAchievedRate,
+    imuFramesSent, imuDroppedFrames, (unsigned long)imuDroppedSamples, (unsigned long)(imuHead - imuTail));
+
+  if (bodyLen < 0) {
+    bodyLen = 0;
+  } else if (bodyLen >= (int)sizeof(body)) {
+    bodyLen = sizeof(body) - 1;
+  }
+
+  sendHttpHeader(client, bodyLen, "application/json");
+  client.write((const uint8_t*)body, bodyLen);
+  client.flush();
+}
+
+// JSON worker pool statistics for /api/http
+void sendHttpStats(WiFiClient &client) {
+  uint32_t served = httpStats.served;
+  char body[384];
+  int bodyLen = snprintf(body, sizeof(body),
+    "{\"workers\":%d,\"busy_workers\":%lu,\"queue_depth\":%lu,\"queue_capacity\":%d,\"queue_depth_max\":%lu,"
+    "\"accepted\":%lu,\"served\":%lu,\"shed\":%lu,\"expired\":%lu,"
+    "\"queue_wait_avg_ms\":%lu,\"latency_avg_ms\":%lu,\"latency_max_ms\":%lu,\"latency_last_ms\":%lu}",
+    HTTP_WORKER_COUNT, (unsigned long)httpBusyWorkers, (unsigned long)httpQueueDepth, HTTP_QUEUE_DEPTH,
+    (unsigned long)httpStats.queueDepthMax,
+    (unsigned long)httpStats.accepted, (unsigned long)served, (unsigned long)httpStats.shed, (unsigned long)httpStats.expired,
+    served ? (unsigned long)(httpStats.queueWaitTotal / served) : 0UL,
+    served ? (unsigned long)(httpStats.latencyTotal / served) : 0UL,
+    (unsigned long)httpStats.latencyMax, (unsigned long)httpStats.latencyLast);
+
+  if (bodyLen < 0) {
+    bodyLen = 0;
+  } else if (bodyLen >= (int)sizeof(body)) {
+    bodyLen = sizeof(body) - 1;
+  }
+
+  sendHttpHeader(client, bodyLen, "application/json");
+  client.write((const uint8_t*)body, bodyLen);
+  client.flush();
+}
+
+// WiFi management function with retry logic
+void manageWiFi() {
+  unsigned long now = millis();
+  
+  // Check WiFi status every 5 seconds
+  if (now - lastWifiCheck > WIFI_CHECK_INTERVAL) {
+    lastWifiCheck = now;
+    
+    if (WiFi.status() != WL_CONNECTED) {
+      LOG_INFO("WiFi disconnected!");
+      if (displayEnabled) {
+        Screen.print(3, "WiFi lost!");
+      }
+      webServerStarted = false;
+      mqttConnected = false;
+      
+      // Try to reconnect every wifi_retry_interval seconds (30 by default)
+      RuntimeSettings settings;
+      settingsRead(settings);
+      if (now - lastWifiRetry > settings.wifiRetryInterval * 1000UL) {
+        lastWifiRetry = now;
+        LOG_INFO("Attempting WiFi reconnection...");
+        if (displayEnabled) {
+          Screen.print(3, "WiFi retry...");
+        }
+        
+        WiFi.disconnect();
+        delay(1000);
+        WiFi.begin(config.ssid, config.password);
+        
+        // Wait up to 10 seconds for connection
+        int attempts = 0;
+        while (WiFi.status() != WL_CONNECTED && attempts < 20) {
+          delay(500);
+          Serial.print(".");
+          attempts++;
+        }
+        
+        if (WiFi.status() == WL_CONNECTED) {
+          metrics.wifiReconnects++;
+          LOG_INFO("WiFi reconnected!");
+          LOG_INFO("IP: %d.%d.%d.%d", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
+          if (displayEnabled) {
+            char ipStr[16];
+            sprintf(ipStr, "%d.%d.%d.%d", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
+            Screen.print(3, ipStr);
+          }
+        } else {
+          metrics.wifiReconnectFailures++;
+          LOG_WARN("WiFi retry failed!");
+          if (displayEnabled) {
+            Screen.print(3, "WiFi failed!");
+          }
+        }
+      }
+    } else {
+      // WiFi is connected
+      if (!webServerStarted) {
+        // Start web server if not already started
+        webServer.begin();
+        webServerStarted = true;
+        LOG_INFO("Web server restarted");
+        LOG_INFO("Access control panel at: http://%d.%d.%d.%d", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
+      }
+    }
+  }
+}
+
+// Route table - (method, path) -> handler, resolved with a compile-time perfect hash
+#define HTTP_METHOD_GET   0x01
+#define HTTP_METHOD_POST  0x02
+#define HTTP_METHOD_ANY   (HTTP_METHOD_GET | HTTP_METHOD_POST)
+
+struct HttpRequest {
+  WiFiClient &client;
+  const char *path;      // Without query string
+  const char *query;     // Text after '?', or ""
+  uint8_t method;
+  bool wsUpgrade;
+  const char *wsKey;
+  bool detached;         // Handler kept the connection open (streams) - skip the shared epilogue
+};
+
+typedef void (*RouteHandler)(HttpRequest &req);
+
+struct Route {
+  const char *path;
+  uint32_t hash;
+  uint8_t methods;
+  RouteHandler handler;
+};
+
+// FNV-1a with a tuned offset basis; routeHash() is evaluated by the compiler for the table,
+// hashPath() at request time. The top ROUTE_BUCKET_BITS bits select the bucket.
+#define ROUTE_HASH_SEED   0x811c9e19u   // Chosen so every route lands in its own bucket
+#define ROUTE_BUCKET_BITS 6
+#define ROUTE_BUCKETS     (1 << ROUTE_BUCKET_BITS)
+
+constexpr uint32_t routeHash(const char *s, uint32_t h = ROUTE_HASH_SEED) {
+  return *s ? routeHash(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+constexpr uint32_t routeBucket(uint32_t hash) {
+  return hash >> (32 - ROUTE_BUCKET_BITS);
+}
+
+uint32_t hashPath(const char *s) {
+  uint32_t h = ROUTE_HASH_SEED;
+  while (*s) {
+    h = (h ^ (uint8_t)*s++) * 16777619u;
+  }
+  return h;
+}
+
+// Shared response epilogue for handlers that don't keep the connection open
+void finishResponse(WiFiClient &client) {
+  client.flush();
+  Thread::wait(10);
+  client.stop();
+  LOG_DEBUG("Client connection closed");
+}
+
+// Status-only responses (404, 405, 426) with a short plain-text body
+void sendHttpStatus(WiFiClient &client, const char *status, const char *extraHeaders = "") {
+  char resp[256];
+  int len = snprintf(resp, sizeof(resp),
+    "HTTP/1.1 %s\r\n"
+    "%s"
+    "Content-Type: text/plain\r\n"
+    "Connection: close\r\n"
+    "Content-Length: %d\r\n"
+    "\r\n"
+    "%s\n",
+    status, extraHeaders, (int)strlen(status) + 1, status);
+  if (len >= (int)sizeof(resp)) len = sizeof(resp) - 1;
+  client.write((const uint8_t *)resp, len);
+}
+
+// Small complete response with an arbitrary status line (JSON API errors and results)
+void sendHttpResponse(WiFiClient &client, const char *status, const char *contentType, const char *body, int bodyLen) {
+  char header[192];
+  int len = snprintf(header, sizeof(header),
+    "HTTP/1.1 %s\r\n"
+    "Content-Type: %s\r\n"
+    "Connection: close\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Content-Length: %d\r\n"
+    "\r\n",
+    status, contentType, bodyLen);
+  if (len >= (int)sizeof(header)) len = sizeof(header) - 1;
+  client.write((const uint8_t *)header, len);
+  client.write((const uint8_t *)body, bodyLen);
+}
+
+void handleRoot(HttpRequest &req) {
+  LOG_DEBUG("Serving main page");
+  sendMainPage(req.client);
+}
+
+void handleControl(HttpRequest &req) {
+  LOG_DEBUG("Serving control page");
+  sendControlPage(req.client);
+}
+
+void handleTelemetry(HttpRequest &req) {
+  LOG_DEBUG("Serving telemetry page");
+  sendTelemetryPage(req.client);
+}
+
+void handleSetup(HttpRequest &req) {
+  LOG_DEBUG("Serving setup page");
+  sendSetupPage(req.client);
+}
+
+// Live telemetry stream (connection stays open)
+void handleEvents(HttpRequest &req) {
+  LOG_INFO("Subscribing telemetry event stream");
+  sseSubscribe(req.client);
+  req.detached = true;
+}
+
+// IMU WebSocket stream (connection stays open after upgrade)
+void handleImu(HttpRequest &req) {
+  if (req.wsUpgrade && req.wsKey[0]) {
+    LOG_INFO("Upgrading to IMU WebSocket stream");
+    imuStreamAccept(req.client, req.wsKey);
+    req.detached = true;
+  } else {
+    sendHttpStatus(req.client, "426 Upgrade Required", "Upgrade: websocket\r\n");
+  }
+}
+
+void handleApiHttp(HttpRequest &req) {
+  sendHttpStats(req.client);
+}
+
+void handleApiImu(HttpRequest &req) {
+  sendImuStats(req.client);
+}
+
+// Read "from"/"to" history times from the query; missing bounds are open
+void historyRange(const char *query, uint32_t &from, uint32_t &to) {
+  char value[12];
+  from = getQueryParam(query, "from", value, sizeof(value)) ? strtoul(value, NULL, 10) : 0;
+  to = getQueryParam(query, "to", value, sizeof(value)) ? strtoul(value, NULL, 10) : 0xFFFFFFFF;
+}
+
+// JSON summary of the history store with a retention estimate
+void handleApiHistoryInfo(HttpRequest &req) {
+  HistoryCursor cur;
+  historyOpen(cur, 0);
+  const HistoryRecord *oldest = historyNext(cur);
+  
+  historyMutex.lock();
+  int head = historyHeadPage;
+  uint32_t headSlot = historyHeadSlot;
+  historyMutex.unlock();
+  
+  uint32_t records = 0;
+  uint32_t newest = 0;
+  if (head >= 0) {
+    for (int page = 0; page < HISTORY_PAGE_COUNT; page++) {
+      if (page != head && historyPageValid(page)) records += HISTORY_RECORDS_PER_PAGE;
+    }
+    records += headSlot;
+    if (headSlot > 0) newest = historyRecords(head)[headSlot - 1].time;
+  }
+  
+  // Recycling a sector drops a whole sector of pages, so retention swings between these two
+  uint32_t capacity = HISTORY_PAGE_COUNT * HISTORY_RECORDS_PER_PAGE;
+  uint32_t minRetained = (HISTORY_PAGE_COUNT - HISTORY_PAGES_PER_SECTOR) * HISTORY_RECORDS_PER_PAGE;
+  
+  RuntimeSettings settings;
+  settingsRead(settings);
+  
+  char body[320];
+  int len = snprintf(body, sizeof(body),
+    "{\"enabled\":%s,\"now\":%lu,\"records\":%lu,\"capacity\":%lu,\"oldest\":%lu,\"newest\":%lu,"
+    "\"interval_s\":%lu,\"retention_min_h\":%lu,\"retention_max_h\":%lu}",
+    historyDisabled ? "false" : "true", (unsigned long)historyNow(), (unsigned long)records,
+    (unsigned long)capacity, oldest ? (unsigned long)oldest->time : 0UL, (unsigned long)newest,
+    (unsigned long)settings.sampleInterval,
+    (unsigned long)((uint64_t)minRetained * settings.sampleInterval / 3600),
+    (unsigned long)((uint64_t)capacity * settings.sampleInterval / 3600));
+  if (len >= (int)sizeof(body)) len = sizeof(body) - 1;
+  sendHttpResponse(req.client, "200 OK", "application/json", body, len);
+}
+
+// Raw samples as CSV for backfilling after an outage: /api/history/raw?from=&to=
+void handleApiHistoryRaw(HttpRequest &req) {
+  uint32_t from, to;
+  historyRange(req.query, from, to);
+  
+  sendHttpHeader(req.client, HTTP_CHUNKED, "text/csv");
+  PageWriter out(req.client);
+  out.print("time,temperature,humidity,pressure,flags\n");
+  
+  HistoryCursor cur;
+  historyOpen(cur, from);
+  const HistoryRecord *r;
+  while ((r = historyNext(cur)) != NULL && r->time <= to) {
+    out.printf("%lu,%.2f,%.2f,%.1f,%u\n", (unsigned long)r->time,
+               r->temperature / 100.0f, r->humidity / 100.0f, r->pressure / 10.0f, (unsigned)r->flags);
+  }
+  out.end();
+}
+
+#define HISTORY_DEFAULT_POINTS 120
+#define HISTORY_MAX_POINTS     1000
+
+const uint8_t historyChannelDecimals[HISTORY_CHANNEL_COUNT] = {2, 2, 1};
+
+void historyEmitPoint(PageWriter &out, const HistoryRecord *r, int channel, bool &first) {
+  out.printf("%s[%lu,%.*f]", first ? "" : ",", (unsigned long)r->time,
+             historyChannelDecimals[channel], historyValue(r, channel));
+  first = false;
+}
+
+// Largest-Triangle-Three-Buckets over the n records at 'cur': keep the first and last
+// record and, from each of points-2 buckets in between, the one forming the largest
+// triangle with the previous pick and the next bucket's average. Works in passes over
+// flash with copies of the cursor, so nothing but the current pick is buffered.
+void historyDownsample(PageWriter &out, HistoryCursor cur, uint32_t n, uint32_t points, int channel) {
+  bool first = true;
+  const HistoryRecord *a = historyNext(cur);
+  if (a == NULL) return;
+  historyEmitPoint(out, a, channel, first);
+  
+  uint32_t bucketStart = 1;
+  for (uint32_t i = 0; i < points - 2; i++) {
+    uint32_t bucketEnd = 1 + (uint32_t)((uint64_t)(i + 1) * (n - 2) / (points - 2));
+    uint32_t nextEnd = (i + 1 < points - 2) ? 1 + (uint32_t)((uint64_t)(i + 2) * (n - 2) / (points - 2)) : n;
+    
+    // Average of the following bucket (the last record for the final bucket)
+    HistoryCursor ahead = cur;
+    const HistoryRecord *r = NULL;
+    for (uint32_t j = bucketStart; j < bucketEnd && (r = historyNext(ahead)) != NULL; j++) {}
+    float avgTime = 0, avgValue = 0;
+    uint32_t avgCount = 0;
+    for (uint32_t j = bucketEnd; j < nextEnd && (r = historyNext(ahead)) != NULL; j++) {
+      avgTime += (float)(r->time - a->time);
+      avgValue += historyValue(r, channel);
+      avgCount++;
+    }
+    if (avgCount == 0) return;  // Pages recycled under us
+    avgTime /= avgCount;
+    avgValue /= avgCount;
+    
+    // Times are taken relative to the previous pick to keep float precision
+    float aValue = historyValue(a, channel);
+    const HistoryRecord *pick = NULL;
+    float pickArea = -1;
+    for (uint32_t j = bucketStart; j < bucketEnd; j++) {
+      if ((r = historyNext(cur)) == NULL) return;
+      float area = fabsf((float)(r->time - a->time) * (avgValue - aValue) -
+                         avgTime * (historyValue(r, channel) - aValue));
+      if (area > pickArea) {
+        pickArea = area;
+        pick = r;
+      }
+    }
+    historyEmitPoint(out, pick, channel, first);
+    a = pick;
+    bucketStart = bucketEnd;
+  }
+  
+  const HistoryRecord *last = historyNext(cur);
+  if (last != NULL) historyEmitPoint(out, last, channel, first);
+}
+
+// Chart data: /api/history?channel=temperature&from=&to=&points=120
+// -> {"channel":"temperature","now":...,"points":[[time,value],...]} with at most 'points' pairs
+void handleApiHistory(HttpRequest &req) {
+  uint32_t from, to;
+  historyRange(req.query, from, to);
+  
+  char value[16];
+  int channel = HISTORY_TEMPERATURE;
+  if (getQueryParam(req.query, "channel", value, sizeof(value))) {
+    for (channel = 0; channel < HISTORY_CHANNEL_COUNT; channel++) {
+      if (strcmp(value, historyChannelNames[channel]) == 0) break;
+    }
+    if (channel == HISTORY_CHANNEL_COUNT) {
+      const char body[] = "{\"error\":\"unknown channel\"}";
+      sendHttpResponse(req.client, "400 Bad Request", "application/json", body, sizeof(body) - 1);
+      return;
+    }
+  }
+  uint32_t points = HISTORY_DEFAULT_POINTS;
+  if (getQueryParam(req.query, "points", value, sizeof(value))) {
+    points = constrain(strtoul(value, NULL, 10), 3UL, (unsigned long)HISTORY_MAX_POINTS);
+  }
+  
+  // Count the records in range first; the bucket edges depend on it
+  HistoryCursor start;
+  historyOpen(start, from);
+  HistoryCursor cur = start;
+  uint32_t n = 0;
+  const HistoryRecord *r;
+  while ((r = historyNext(cur)) != NULL && r->time <= to) n++;
+  
+  sendHttpHeader(req.client, HTTP_CHUNKED, "application/json");
+  PageWriter out(req.client);
+  out.printf("{\"channel\":\"%s\",\"now\":%lu,\"points\":[", historyChannelNames[channel],
+             (unsigned long)historyNow());
+  if (n > points) {
+    historyDownsample(out, start, n, points, channel);
+  } else {
+    bool first = true;
+    for (uint32_t i = 0; i < n && (r = historyNext(start)) != NULL; i++) {
+      historyEmitPoint(out, r, channel, first);
+    }
+  }
+  out.print("]}");
+  out.end();
+}
+
+void handleSaveConfig(HttpRequest &req) {
+  LOG_INFO("Saving configuration from web form...");
+  
+  // Parse all parameters from the query string (other workers may be reading config)
+  char tempBuffer[64];
+  controlMutex.lock();
+  
+  if (getQueryParam(req.query, "deviceId", tempBuffer, sizeof(tempBuffer))) {
+    strncpy(config.deviceId, tempBuffer, sizeof(config.deviceId) - 1);
+    config.deviceId[sizeof(config.deviceId) - 1] = 0;
+  }
+  if (getQueryParam(req.query, "model", tempBuffer, sizeof(tempBuffer))) {
+    strncpy(config.model, tempBuffer, sizeof(config.model) - 1);
+    config.model[sizeof(config.model) - 1] = 0;
+  }
+  if (getQueryParam(req.query, "location", tempBuffer, sizeof(tempBuffer))) {
+    strncpy(config.location, tempBuffer, sizeof(config.location) - 1);
+    config.location[sizeof(config.location) - 1] = 0;
+  }
+  if (getQueryParam(req.query, "ssid", tempBuffer, sizeof(tempBuffer))) {
+    strncpy(config.ssid, tempBuffer, sizeof(config.ssid) - 1);
+    config.ssid[sizeof(config.ssid) - 1] = 0;
+  }
+  if (getQueryParam(req.query, "password", tempBuffer, sizeof(tempBuffer))) {
+    strncpy(config.password, tempBuffer, sizeof(config.password) - 1);
+    config.password[sizeof(config.password) - 1] = 0;
+  }
+  if (getQueryParam(req.query, "mqttServer", tempBuffer, sizeof(tempBuffer))) {
+    strncpy(config.mqttServer, tempBuffer, sizeof(config.mqttServer) - 1);
+    config.mqttServer[sizeof(config.mqttServer) - 1] = 0;
+  }
+  if (getQueryParam(req.query, "mqttPort", tempBuffer, sizeof(tempBuffer))) {
+    int port = atoi(tempBuffer);
+    if (port > 0 && port <= 65535) {
+      config.mqttPort = port;
+    }
+  }
+  if (getQueryParam(req.query, "mqttTopic", tempBuffer, sizeof(tempBuffer))) {
+    strncpy(config.mqttTopic, tempBuffer, sizeof(config.mqttTopic) - 1);
+    config.mqttTopic[sizeof(config.mqttTopic) - 1] = 0;
+  }
+  if (getQueryParam(req.query, "syslogHost", tempBuffer, sizeof(tempBuffer))) {
+    IPAddress syslogIP;
+    if (tempBuffer[0] == '\0' || parseIPv4(tempBuffer, syslogIP)) {
+      strncpy(config.syslogHost, tempBuffer, sizeof(config.syslogHost) - 1);
+      config.syslogHost[sizeof(config.syslogHost) - 1] = 0;
+    }
+  }
+  if (getQueryParam(req.query, "syslogPort", tempBuffer, sizeof(tempBuffer))) {
+    int port = atoi(tempBuffer);
+    if (port > 0 && port <= 65535) {
+      config.syslogPort = port;
+    }
+  }
+  
+  // Save to Flash
+  LOG_INFO("Writing configuration to Flash...");
+  bool saved = saveConfigToFlash();
+  controlMutex.unlock();
+  if (saved) {
+    LOG_INFO("Configuration saved successfully!");
+    sendSuccessPage(req.client);
+  } else {
+    LOG_ERROR("Failed to save configuration!");
+    sendMainPage(req.client);
+  }
+}
+
+// Single-switch routes take ?state=on|off; /led and /display keep their debounce
+void handleSwitch(HttpRequest &req, int act, unsigned long *lastChange) {
+  char value[16];
+  bool on;
+  if (getQueryParam(req.query, "state", value, sizeof(value)) && parseSwitchValue(value, strlen(value), on)) {
+    unsigned long now = millis();
+    controlMutex.lock();
+    if (lastChange == NULL || now - *lastChange > DEBOUNCE_DELAY) {
+      applyActuator(act, on);
+      LOG_INFO("%s%s", actuatorNames[act], on ? " turned ON" : " turned OFF");
+    }
+    controlMutex.unlock();
+  }
+  sendControlPage(req.client);
+}
+
+void handleLed(HttpRequest &req) {
+  handleSwitch(req, ACT_LED, &lastLedChange);
+}
+
+void handleDisplay(HttpRequest &req) {
+  handleSwitch(req, ACT_DISPLAY, &lastDisplayChange);
+}
+
+void handleWifiLed(HttpRequest &req) {
+  handleSwitch(req, ACT_WIFI_LED, NULL);
+}
+
+void handleAzureLed(HttpRequest &req) {
+  handleSwitch(req, ACT_AZURE_LED, NULL);
+}
+
+void handleUserLed(HttpRequest &req) {
+  handleSwitch(req, ACT_USER_LED, NULL);
+}
+
+void handleWatchdog(HttpRequest &req) {
+  handleSwitch(req, ACT_WATCHDOG, NULL);
+}
+
+// Batch control: /api/control?led=on&display=off&userled=on -> one compact JSON status
+void handleApiControl(HttpRequest &req) {
+  char error[64];
+  if (!applyActuatorBatch(req.query, error, sizeof(error))) {
+    char body[96];
+    int len = snprintf(body, sizeof(body), "{\"error\":\"%s\"}", error);
+    sendHttpResponse(req.client, "400 Bad Request", "application/json", body, len);
+    return;
+  }
+  char body[128];
+  int len = formatActuatorStatus(body, sizeof(body));
+  sendHttpResponse(req.client, "200 OK", "application/json", body, len);
+}
+
+// Runtime settings: /api/settings shows them, /api/settings?sample_interval=10&persist=1 changes them
+void handleApiSettings(HttpRequest &req) {
+  char body[256];
+  if (req.query[0] != '\0') {
+    char error[64];
+    if (!applySettingsBatch(req.query, error, sizeof(error))) {
+      int len = snprintf(body, sizeof(body), "{\"error\":\"%s\"}", error);
+      sendHttpResponse(req.client, "400 Bad Request", "application/json", body, len);
+      return;
+    }
+  }
+  int len = formatSettings(body, sizeof(body));
+  sendHttpResponse(req.client, "200 OK", "application/json", body, len);
+}
+
+void handleReset(HttpRequest &req) {
+  LOG_INFO("RESET requested via web interface");
+  sendControlPage(req.client);
+  finishResponse(req.client);
+  req.detached = true;
+  logFlush();
+  Thread::wait(100);
+  NVIC_SystemReset();
+}
+
+// Profiling report; the route stays in the table so builds without profiling say how to enable it
+void handleDebugProfile(HttpRequest &req) {
+#if ENABLE_PROFILING
+  char reset[4];
+  if (getQueryParam(req.query, "reset", reset, sizeof(reset)) && strcmp(reset, "1") == 0) {
+    profileReset();
+  }
+  sendHttpHeader(req.client, HTTP_CHUNKED, "text/plain");
+  PageWriter out(req.client);
+  char line[128];
+  out.print(PROFILE_REPORT_HEADER);
+  for (int i = 0; i < PROF_COUNT; i++) {
+    out.write(line, formatProfileRow(line, sizeof(line), i));
+  }
+  out.end();
+#else
+  const char body[] = "Profiling is disabled; build the az3166_profile environment (-DENABLE_PROFILING=1)\n";
+  sendHttpResponse(req.client, "404 Not Found", "text/plain", body, sizeof(body) - 1);
+#endif
+}
+
+// Defined after the route table, which it walks for the per-route counters
+void handleMetrics(HttpRequest &req);
+
+#define ROUTE(path, methods, handler) { path, routeHash(path), methods, handler }
+
+constexpr Route routes[] = {
+  ROUTE("/",                 HTTP_METHOD_GET, handleRoot),
+  ROUTE("/control",          HTTP_METHOD_GET, handleControl),
+  ROUTE("/telemetry",        HTTP_METHOD_GET, handleTelemetry),
+  ROUTE("/setup",            HTTP_METHOD_GET, handleSetup),
+  ROUTE("/events",           HTTP_METHOD_GET, handleEvents),
+  ROUTE("/imu",              HTTP_METHOD_GET, handleImu),
+  ROUTE("/api/http",         HTTP_METHOD_GET, handleApiHttp),
+  ROUTE("/api/imu",          HTTP_METHOD_GET, handleApiImu),
+  ROUTE("/save-config",      HTTP_METHOD_ANY, handleSaveConfig),
+  ROUTE("/led",              HTTP_METHOD_ANY, handleLed),
+  ROUTE("/display",          HTTP_METHOD_ANY, handleDisplay),
+  ROUTE("/wifiled",          HTTP_METHOD_ANY, handleWifiLed),
+  ROUTE("/azureled",         HTTP_METHOD_ANY, handleAzureLed),
+  ROUTE("/userled",          HTTP_METHOD_ANY, handleUserLed),
+  ROUTE("/reset",            HTTP_METHOD_ANY, handleReset),
+  ROUTE("/watchdog",         HTTP_METHOD_ANY, handleWatchdog),
+  ROUTE("/api/control",      HTTP_METHOD_ANY, handleApiControl),
+  ROUTE("/api/settings",     HTTP_METHOD_ANY, handleApiSettings),
+  ROUTE("/metrics",          HTTP_METHOD_GET, handleMetrics),
+  ROUTE("/debug/profile",    HTTP_METHOD_GET, handleDebugProfile),
+  ROUTE("/api/history",      HTTP_METHOD_GET, handleApiHistory),
+  ROUTE("/api/history/info", HTTP_METHOD_GET, handleApiHistoryInfo),
+  ROUTE("/api/history/raw",  HTTP_METHOD_GET, handleApiHistoryRaw),
+};
+constexpr int ROUTE_COUNT = sizeof(routes) / sizeof(routes[0]);
+
+// Per-route counters for /metrics, indexed like routes[]
+struct RouteMetrics {
+  volatile uint32_t requests;
+  volatile uint32_t serviceMs;  // Handler time; detached streams count until hand-off
+};
+
+RouteMetrics routeMetrics[ROUTE_COUNT];
+
+
+// Every route must have its own bucket. If a new route trips this assert, pick another
+// ROUTE_HASH_SEED (any value works as long as the assert passes).
+constexpr bool routeBucketsUnique(int i = 0, int j = 1) {
+  return i >= ROUTE_COUNT ? true :
+         j >= ROUTE_COUNT ? routeBucketsUnique(i + 1, i + 2) :
+         (routeBucket(routes[i].hash) != routeBucket(routes[j].hash)) && routeBucketsUnique(i, j + 1);
+}
+static_assert(routeBucketsUnique(), "Route table hash collision - change ROUTE_HASH_SEED");
+
+constexpr int8_t routeForBucket(uint32_t bucket, int i = 0) {
+  return i >= ROUTE_COUNT ? -1 : (routeBucket(routes[i].hash) == bucket ? i : routeForBucket(bucket, i + 1));
+}
+
+#define ROUTE_BUCKET_ROW(n) routeForBucket(n), routeForBucket(n + 1), routeForBucket(n + 2), routeForBucket(n + 3), \
+                            routeForBucket(n + 4), routeForBucket(n + 5), routeForBucket(n + 6), routeForBucket(n + 7)
+
+constexpr int8_t routeIndex[ROUTE_BUCKETS] = {
+  ROUTE_BUCKET_ROW(0),  ROUTE_BUCKET_ROW(8),  ROUTE_BUCKET_ROW(16), ROUTE_BUCKET_ROW(24),
+  ROUTE_BUCKET_ROW(32), ROUTE_BUCKET_ROW(40), ROUTE_BUCKET_ROW(48), ROUTE_BUCKET_ROW(56)
+};
+static_assert(sizeof(routeIndex) == ROUTE_BUCKETS, "routeIndex rows must cover ROUTE_BUCKETS");
+
+// Constant-time lookup: one hash, one table probe, one strcmp
+const Route *findRoute(const char *path) {
+  int8_t idx = routeIndex[routeBucket(hashPath(path))];
+  if (idx < 0 || strcmp(routes[idx].path, path) != 0) {
+    return NULL;
+  }
+  return &routes[idx];
+}
+
+void dispatchRequest(HttpRequest &req) {
+  const Route *route = findRoute(req.path);
+  
+  if (route == NULL) {
+    LOG_INFO("Unknown path: %s", req.path);
+    core_util_atomic_incr_u32(&metrics.httpUnmatched, 1);
+    sendHttpStatus(req.client, "404 Not Found");
+  } else if (!(route->methods & req.method)) {
+    sendHttpStatus(req.client, "405 Method Not Allowed", "Allow: GET\r\n");
+  } else {
+    RouteMetrics &rm = routeMetrics[route - routes];
+    unsigned long start = millis();
+    route->handler(req);
+    core_util_atomic_incr_u32(&rm.serviceMs, millis() - start);
+    core_util_atomic_incr_u32(&rm.requests, 1);
+  }
+  
+  if (!req.detached) {
+    finishResponse(req.client);
+  }
 }
 
-// Web server functions - optimized for speed
+// Prometheus text exposition - written straight through PageWriter, no heap and no large buffers
+void metricHeader(PageWriter &out, const char *name, const char *type, const char *help) {
+  out.print("# HELP ");
+  out.print(name);
+  out.print(" ");
+  out.print(help);
+  out.print("\n# TYPE ");
+  out.print(name);
+  out.print(" ");
+  out.print(type);
+  out.print("\n");
+}
 
-// Standard HTTP 200 header with no-cache semantics
-void sendHttpHeader(WiFiClient &client, int contentLength, const char *contentType = "text/html") {
-  char header[256];
-  
-  int headerLen = snprintf(
-    header,
-    sizeof(header),
-    "HTTP/1.1 200 OK\r\n"
-    "Content-Type: %s\r\n"
-    "Connection: close\r\n"
-    "Cache-Control: no-cache, no-store, must-revalidate\r\n"
-    "Pragma: no-cache\r\n"
-    "Expires: 0\r\n"
-    "Content-Length: %d\r\n"
-    "\r\n",
-    contentType,
-    contentLength
-  );
-  
-  if (headerLen < 0) {
-    headerLen = 0;
-  } else if (headerLen >= (int)sizeof(header)) {
-    headerLen = sizeof(header) - 1;
+void metricValue(PageWriter &out, const char *name, uint32_t value) {
+  out.print(name);
+  out.printf(" %lu\n", (unsigned long)value);
+}
+
+void metricCounter(PageWriter &out, const char *name, const char *help, uint32_t value) {
+  metricHeader(out, name, "counter", help);
+  metricValue(out, name, value);
+}
+
+void metricGauge(PageWriter &out, const char *name, const char *help, uint32_t value) {
+  metricHeader(out, name, "gauge", help);
+  metricValue(out, name, value);
+}
+
+// Values are stored in ms or us; Prometheus wants seconds
+void printSeconds(PageWriter &out, uint32_t value, uint32_t unitsPerSecond) {
+  if (unitsPerSecond == 1000) {
+    out.printf("%lu.%03lu", (unsigned long)(value / 1000), (unsigned long)(value % 1000));
+  } else {
+    out.printf("%lu.%06lu", (unsigned long)(value / 1000000), (unsigned long)(value % 1000000));
   }
-  
-  client.write((const uint8_t *)header, headerLen);
 }
 
-void sendMainPage(WiFiClient &client) {
-  Serial.println("Sending main page");
-  
-  char body[1600];
-  int bodyLen = snprintf(body, sizeof(body),
-    "<!DOCTYPE html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'><title>%s</title>"
-    "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:20px;background:#f5f5f7;max-width:500px;margin:0 auto;text-align:center}"
-    ".c{background:#fff;border-radius:12px;padding:30px;margin-bottom:12px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
-    "h1{margin:0 0 8px;font-size:24px;font-weight:600}"
-    ".s{font-size:13px;color:#666;margin-bottom:16px;display:flex;align-items:center;gap:8px;justify-content:center;flex-wrap:wrap}"
-    ".b{padding:4px 8px;border-radius:4px;font-size:11px;font-weight:600;white-space:nowrap}"
-    ".on{background:#34c759;color:#fff}.off{background:#ff3b30;color:#fff}"
-    "a{display:block;width:100%%;padding:18px;border:none;border-radius:10px;text-align:center;font-weight:600;font-size:18px;cursor:pointer;margin:12px 0;text-decoration:none;transition:opacity 0.2s}"
-    "a:active{opacity:0.7}"
-    ".btn-b{background:#007aff;color:#fff}.btn-o{background:#ff9500;color:#fff}.ver{font-size:11px;color:#999;margin-top:16px}"
-    "</style></head><body>"
-    "<div class='c'><h1>%s</h1>"
-    "<div class='s'><span>MQTT:</span><span class='b %s'>%s</span><span style='color:#999'>|</span><span style='color:#999'>%s</span></div>"
-    "<a href='/control' class='btn-b'>CONTROL</a>"
-    "<a href='/telemetry' style='background:#5856d6;color:#fff'>TELEMETRY</a>"
-    "<a href='/setup' class='btn-o'>SETUP</a>"
-    "<div class='ver'>v%s</div>"
-    "</div></body></html>",
-    config.deviceId, config.deviceId,
-    mqttConnected ? "on" : "off",
-    mqttConnected ? "CONNECTED" : "DISCONNECTED",
-    config.mqttServer, FIRMWARE_VERSION);
-  
-  if (bodyLen < 0) {
-    bodyLen = 0;
-  } else if (bodyLen >= (int)sizeof(body)) {
-    bodyLen = sizeof(body) - 1;
-    Serial.print("WARNING: Main page HTML truncated! Buffer size: ");
-    Serial.println(sizeof(body));
+// One histogram series; label may be NULL or a preformatted 'key="value"' pair
+void metricHistogram(PageWriter &out, const char *name, const char *label, const Histogram &h) {
+  uint32_t cumulative = 0;
+  for (int i = 0; i <= METRIC_BUCKETS; i++) {
+    cumulative += h.buckets[i];
+    out.print(name);
+    out.print("_bucket{");
+    if (label) {
+      out.print(label);
+      out.print(",");
+    }
+    out.print("le=\"");
+    if (i < METRIC_BUCKETS) {
+      printSeconds(out, h.bounds[i], h.unitsPerSecond);
+    } else {
+      out.print("+Inf");
+    }
+    out.printf("\"} %lu\n", (unsigned long)cumulative);
+  }
+  const char *suffixes[2] = {"_sum", "_count"};
+  for (int i = 0; i < 2; i++) {
+    out.print(name);
+    out.print(suffixes[i]);
+    if (label) {
+      out.print("{");
+      out.print(label);
+      out.print("}");
+    }
+    out.print(" ");
+    if (i == 0) {
+      printSeconds(out, h.sum, h.unitsPerSecond);
+      out.print("\n");
+    } else {
+      out.printf("%lu\n", (unsigned long)h.count);
+    }
   }
-  
-  Serial.print("Main page HTML size: ");
-  Serial.println(bodyLen);
-  
-  sendHttpHeader(client, bodyLen, "text/html");
-  client.write((const uint8_t*)body, bodyLen);
-  client.flush();
-  Serial.println("Main page sent!");
 }
 
-void sendControlPage(WiFiClient &client) {
-  Serial.println("Sending control page");
-  
-  char body[3200];
-  
-  // Calculate time since last network activity for watchdog display
-  unsigned long timeSinceActivity = (millis() - lastSuccessfulNetworkActivity) / 1000; // seconds
-  unsigned long timeoutRemaining = 0;
-  if (watchdogEnabled && timeSinceActivity < (NETWORK_WATCHDOG_TIMEOUT / 1000)) {
-    timeoutRemaining = (NETWORK_WATCHDOG_TIMEOUT / 1000) - timeSinceActivity;
+void handleMetrics(HttpRequest &req) {
+  sendHttpHeader(req.client, HTTP_CHUNKED, "text/plain; version=0.0.4");
+  PageWriter out(req.client);
+  
+  metricGauge(out, "az3166_uptime_seconds", "Seconds since boot.", millis() / 1000);
+  
+  struct mallinfo heap = mallinfo();
+  metricGauge(out, "az3166_heap_used_bytes", "Bytes allocated from the heap.", heap.uordblks);
+  metricGauge(out, "az3166_heap_free_bytes", "Free bytes inside the heap arena.", heap.fordblks);
+  
+  metricCounter(out, "az3166_mqtt_connects_total", "Successful MQTT connections.", metrics.mqttConnects);
+  metricCounter(out, "az3166_mqtt_connect_failures_total", "Failed MQTT connection attempts.", metrics.mqttConnectFailures);
+  metricCounter(out, "az3166_mqtt_publishes_total", "MQTT messages published.", metrics.mqttPublishes);
+  metricCounter(out, "az3166_mqtt_publish_failures_total", "MQTT publishes that failed.", metrics.mqttPublishFailures);
+  metricCounter(out, "az3166_mqtt_written_bytes_total", "Bytes written to the MQTT connection.", metrics.mqttBytesWritten);
+  metricHeader(out, "az3166_mqtt_publish_duration_seconds", "histogram", "Time to write and flush one PUBLISH.");
+  metricHistogram(out, "az3166_mqtt_publish_duration_seconds", NULL, metrics.mqttPublishTime);
+  
+  metricCounter(out, "az3166_wifi_reconnects_total", "WiFi reconnections after a drop.", metrics.wifiReconnects);
+  metricCounter(out, "az3166_wifi_reconnect_failures_total", "WiFi reconnection attempts that failed.", metrics.wifiReconnectFailures);
+  metricCounter(out, "az3166_watchdog_near_misses_total",
+                "Recoveries after more than half the network watchdog timeout.", metrics.watchdogNearMisses);
+  metricGauge(out, "az3166_watchdog_enabled", "1 if the network watchdog is armed.", watchdogEnabled ? 1 : 0);
+  
+  metricHeader(out, "az3166_http_requests_total", "counter", "HTTP requests by route.");
+  for (int i = 0; i < ROUTE_COUNT; i++) {
+    out.print("az3166_http_requests_total{route=\"");
+    out.print(routes[i].path);
+    out.printf("\"} %lu\n", (unsigned long)routeMetrics[i].requests);
   }
-  
-  int bodyLen = snprintf(body, sizeof(body),
-    "<!DOCTYPE html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'><title>Control - %s</title>"
-    "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:10px;background:#f5f5f7;max-width:500px;margin:0 auto}"
-    ".c{background:#fff;border-radius:12px;padding:16px;margin-bottom:12px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
-    "h2{margin:0 0 8px;font-size:20px;font-weight:600}"
-    ".s{font-size:13px;color:#666;margin-bottom:4px;display:flex;align-items:center;gap:8px;flex-wrap:wrap}"
-    ".b{padding:4px 8px;border-radius:4px;font-size:11px;font-weight:600;white-space:nowrap}"
-    ".on{background:#34c759;color:#fff}.off{background:#ff3b30;color:#fff}"
-    ".row{display:flex;gap:8px;margin:8px 0}"
-    "form{flex:1;margin:0}"
-    "button,a{display:block;width:100%%;padding:14px;border:none;border-radius:10px;text-align:center;font-weight:600;font-size:16px;cursor:pointer;transition:opacity 0.2s;-webkit-tap-highlight-color:transparent;text-decoration:none;margin:0}"
-    "button:active,a:active{opacity:0.7}"
-    ".g{background:#007aff;color:#fff}.r{background:#8e8e93;color:#fff}.u{background:#007aff;color:#fff}.gray{background:#8e8e93;color:#fff}"
-    "@media(min-width:400px){body{padding:15px}.c{padding:20px}button,a{font-size:15px}}"
-    "</style></head><body>"
-    "<div class='c'><h2>%s</h2>"
-    "<div class='s'><span>MQTT:</span><span class='b %s'>%s</span><span style='color:#999'>|</span><span style='color:#999'>%s</span></div>"
-    "<div class='s'><span>Watchdog:</span><span class='b %s'>%s</span>%s</div></div>"
-    "<div class='c'>"
-    "<div class='row'><form action='/led' method='GET'><input type='hidden' name='state' value='on'><button class='g'>LED ON</button></form>"
-    "<form action='/led' method='GET'><input type='hidden' name='state' value='off'><button class='r'>LED OFF</button></form></div>"
-    "<div class='row'><form action='/display' method='GET'><input type='hidden' name='state' value='on'><button class='g'>Display ON</button></form>"
-    "<form action='/display' method='GET'><input type='hidden' name='state' value='off'><button class='r'>Display OFF</button></form></div>"
-    "<div class='row'><form action='/wifiled' method='GET'><input type='hidden' name='state' value='on'><button class='g'>WiFi LED ON</button></form>"
-    "<form action='/wifiled' method='GET'><input type='hidden' name='state' value='off'><button class='r'>WiFi LED OFF</button></form></div>"
-    "<div class='row'><form action='/azureled' method='GET'><input type='hidden' name='state' value='on'><button class='g'>Azure LED ON</button></form>"
-    "<form action='/azureled' method='GET'><input type='hidden' name='state' value='off'><button class='r'>Azure LED OFF</button></form></div>"
-    "<div class='row'><form action='/userled' method='GET'><input type='hidden' name='state' value='on'><button class='g'>User LED ON</button></form>"
-    "<form action='/userled' method='GET'><input type='hidden' name='state' value='off'><button class='r'>User LED OFF</button></form></div>"
-    "<div class='row'><form action='/watchdog' method='GET'><input type='hidden' name='state' value='enable'><button class='g'>Watchdog ON</button></form>"
-    "<form action='/watchdog' method='GET'><input type='hidden' name='state' value='disable'><button class='r'>Watchdog OFF</button></form></div>"
-    "<form action='/reset' method='GET' style='margin:16px 0 8px'><button class='u'>RESET</button></form>"
-    "<a href='/' class='gray'>BACK</a>"
-    "</div></body></html>",
-    config.deviceId,
-    config.deviceId,
-    mqttConnected ? "on" : "off",
-    mqttConnected ? "CONNECTED" : "DISCONNECTED",
-    config.mqttServer,
-    watchdogEnabled ? "on" : "off",
-    watchdogEnabled ? "ENABLED" : "DISABLED",
-    watchdogEnabled ? (timeoutRemaining > 0 ? "<span style='color:#999'> | </span><span style='color:#999'>OK</span>" : "") : "");
-  
-  if (bodyLen < 0) {
-    bodyLen = 0;
-  } else if (bodyLen >= (int)sizeof(body)) {
-    bodyLen = sizeof(body) - 1;
-    Serial.print("WARNING: Control page HTML truncated! Buffer size: ");
-    Serial.println(sizeof(body));
+  out.printf("az3166_http_requests_total{route=\"unmatched\"} %lu\n", (unsigned long)metrics.httpUnmatched);
+  metricHeader(out, "az3166_http_route_duration_seconds", "summary", "Handler time by route.");
+  for (int i = 0; i < ROUTE_COUNT; i++) {
+    const char *suffixes[2] = {"_sum", "_count"};
+    for (int j = 0; j < 2; j++) {
+      out.print("az3166_http_route_duration_seconds");
+      out.print(suffixes[j]);
+      out.print("{route=\"");
+      out.print(routes[i].path);
+      out.print("\"} ");
+      if (j == 0) {
+        printSeconds(out, routeMetrics[i].serviceMs, 1000);
+        out.print("\n");
+      } else {
+        out.printf("%lu\n", (unsigned long)routeMetrics[i].requests);
+      }
+    }
+  }
+  metricHeader(out, "az3166_http_request_duration_seconds", "histogram", "Accept-to-close time of served connections.");
+  metricHistogram(out, "az3166_http_request_duration_seconds", NULL, metrics.httpServiceTime);
+  metricCounter(out, "az3166_http_shed_total", "Connections rejected with 503.", httpStats.shed);
+  metricCounter(out, "az3166_http_expired_total", "Connections that expired in the queue.", httpStats.expired);
+  
+  metricHeader(out, "az3166_sensor_read_duration_seconds", "histogram", "Time to read one sensor over I2C.");
+  for (int i = 0; i < SENSOR_COUNT; i++) {
+    char label[24];
+    snprintf(label, sizeof(label), "sensor=\"%s\"", sensorNames[i]);
+    metricHistogram(out, "az3166_sensor_read_duration_seconds", label, metrics.sensorReadTime[i]);
   }
   
-  Serial.print("Control page HTML size: ");
-  Serial.println(bodyLen);
+  metricCounter(out, "az3166_log_dropped_total", "Log messages dropped because the log ring was full.", logDropped);
+  metricCounter(out, "az3166_syslog_datagrams_total", "Remote log datagrams sent.", metrics.syslogDatagrams);
+  metricCounter(out, "az3166_syslog_dropped_total", "Log lines not shipped because of the rate limit.", metrics.syslogDropped);
   
-  sendHttpHeader(client, bodyLen, "text/html");
-  client.write((const uint8_t*)body, bodyLen);
-  client.flush();
-  Serial.println("Control page sent!");
+  metricHeader(out, "az3166_loop_duration_seconds", "histogram", "Main loop iteration time, excluding the idle delay.");
+  metricHistogram(out, "az3166_loop_duration_seconds", NULL, metrics.loopTime);
+  
+  out.end();
 }
 
-void sendTelemetryPage(WiFiClient &client) {
-  Serial.println("Sending telemetry page");
+// Handle one HTTP connection: parse the request line and headers, then route it
+void handleHttpClient(WiFiClient &client, unsigned long deadline) {
+  LOG_DEBUG(">>> Web client connected <<<");
+  
+  // Wait for incoming data, but never past this connection's deadline
+  unsigned long start = millis();
+  while (!client.available() && client.connected() &&
+         (millis() - start < HTTP_FIRST_BYTE_TIMEOUT) && (long)(deadline - millis()) > 0) {
+    Thread::wait(1);
+  }
   
-  char body[2560];
-  int bodyLen = snprintf(body, sizeof(body),
-    "<!DOCTYPE html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'><title>Telemetry - %s</title>"
-    "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:10px;background:#f5f5f7;max-width:500px;margin:0 auto}"
-    ".c{background:#fff;border-radius:12px;padding:16px;margin-bottom:12px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
-    "h2{margin:0 0 12px;font-size:20px;font-weight:600}"
-    "h3{margin:16px 0 8px;font-size:16px;font-weight:600;color:#666}"
-    ".row{display:flex;justify-content:space-between;padding:8px 0;border-bottom:1px solid #f0f0f0}"
-    ".row:last-child{border-bottom:none}"
-    ".label{font-weight:600;color:#333}"
-    ".value{color:#666}"
-    "a{display:block;width:100%%;padding:14px;border:none;border-radius:10px;text-align:center;font-weight:600;font-size:16px;cursor:pointer;transition:opacity 0.2s;text-decoration:none;margin-top:12px}"
-    "a:active{opacity:0.7}"
-    ".gray{background:#8e8e93;color:#fff}"
-    "</style></head><body>"
-    "<div class='c'><h2>Telemetry Data</h2>"
-    "<h3>Environment</h3>"
-    "<div class='row'><span class='label'>Temperature</span><span class='value'>%.2f C</span></div>"
-    "<div class='row'><span class='label'>Humidity</span><span class='value'>%.2f %%</span></div>"
-    "<div class='row'><span class='label'>Pressure</span><span class='value'>%.2f mbar</span></div>"
-    "<h3>Accelerometer</h3>"
-    "<div class='row'><span class='label'>X-axis</span><span class='value'>%.3f g</span></div>"
-    "<div class='row'><span class='label'>Y-axis</span><span class='value'>%.3f g</span></div>"
-    "<div class='row'><span class='label'>Z-axis</span><span class='value'>%.3f g</span></div>"
-    "<h3>Gyroscope</h3>"
-    "<div class='row'><span class='label'>X-axis</span><span class='value'>%.2f dps</span></div>"
-    "<div class='row'><span class='label'>Y-axis</span><span class='value'>%.2f dps</span></div>"
-    "<div class='row'><span class='label'>Z-axis</span><span class='value'>%.2f dps</span></div>"
-    "<h3>Magnetometer</h3>"
-    "<div class='row'><span class='label'>X-axis</span><span class='value'>%.3f G</span></div>"
-    "<div class='row'><span class='label'>Y-axis</span><span class='value'>%.3f G</span></div>"
-    "<div class='row'><span class='label'>Z-axis</span><span class='value'>%.3f G</span></div>"
-    "</div>"
-    "</div>"
-    "<a href='/' class='gray'>BACK</a>"
-    "</body></html>",
-    config.deviceId,
-    lastTemperature, lastHumidity, lastPressure,
-    lastAccelX, lastAccelY, lastAccelZ,
-    lastGyroX, lastGyroY, lastGyroZ,
-    lastMagX, lastMagY, lastMagZ);
+  if (!client.available()) {
+    LOG_WARN("No data received within timeout, closing");
+    client.stop();
+    return;
+  }
   
-  if (bodyLen < 0) {
-    bodyLen = 0;
-  } else if (bodyLen >= (int)sizeof(body)) {
-    bodyLen = sizeof(body) - 1;
-    Serial.print("WARNING: Telemetry page HTML truncated! Buffer size: ");
-    Serial.println(sizeof(body));
+  // Read the first request line: "GET /path HTTP/1.1"
+  String requestLine = "";
+  unsigned long readStart = millis();
+  while (client.available() && requestLine.length() < 512 && millis() - readStart < 100) {
+    char c = client.read();
+    if (c == '\r') continue;
+    if (c == '\n') break;
+    requestLine += c;
   }
+  requestLine.trim();
   
-  Serial.print("Telemetry page HTML size: ");
-  Serial.println(bodyLen);
+  LOG_DEBUG("HTTP request line: %s", requestLine.c_str());
   
-  sendHttpHeader(client, bodyLen, "text/html");
-  client.write((const uint8_t*)body, bodyLen);
-  client.flush();
-  Serial.println("Telemetry page sent!");
-}
-
-void sendSetupPage(WiFiClient &client) {
-  unsigned long sendStart = millis();
-  Serial.print("Sending setup page at ");
-  Serial.println(sendStart);
+  // Parse HTTP method and path
+  bool isPost = requestLine.startsWith("POST ");
+  bool isGet = requestLine.startsWith("GET ");
   
-  // Larger buffer for setup page with form inputs
-  char body[3072];
-  int bodyLen = snprintf(body, sizeof(body),
-    "<!DOCTYPE html><html><head><meta name='viewport' content='width=device-width,initial-scale=1'><title>Setup - %s</title>"
-    "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:10px;background:#f5f5f7;max-width:500px;margin:0 auto}"
-    ".c{background:#fff;border-radius:12px;padding:16px;margin-bottom:12px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
-    "h2{margin:0 0 12px;font-size:20px;font-weight:600}"
-    "label{display:block;font-size:13px;font-weight:600;color:#333;margin:12px 0 4px}"
-    "input{width:100%%;padding:10px;border:1px solid #ddd;border-radius:8px;font-size:15px}"
-    "input:focus{outline:none;border-color:#007aff}"
-    "button,a{display:block;width:100%%;padding:14px;border:none;border-radius:10px;text-align:center;font-weight:600;font-size:16px;cursor:pointer;transition:opacity 0.2s;-webkit-tap-highlight-color:transparent;text-decoration:none;margin-top:12px}"
-    "button:active,a:active{opacity:0.7}"
-    ".g{background:#34c759;color:#fff}.gray{background:#8e8e93;color:#fff}"
-    ".note{font-size:12px;color:#999;margin-top:8px}"
-    "@media(min-width:400px){body{padding:15px}.c{padding:20px}}"
-    "</style></head><body>"
-    "<div class='c'><h2>Device Setup</h2>"
-    "<form action='/save-config' method='GET'>"
-    "<label>Device ID</label><input name='deviceId' value='%s' maxlength='31'>"
-    "<label>Model</label><input name='model' value='%s' maxlength='15'>"
-    "<label>Location</label><input name='location' value='%s' maxlength='31'>"
-    "<label>WiFi SSID</label><input name='ssid' value='%s' maxlength='31'>"
-    "<label>WiFi Password</label><input name='password' type='password' value='%s' maxlength='63'>"
-    "<label>MQTT Server</label><input name='mqttServer' value='%s' maxlength='63'>"
-    "<label>MQTT Port</label><input name='mqttPort' type='number' value='%d' min='1' max='65535'>"
-    "<label>MQTT Topic</label><input name='mqttTopic' value='%s' maxlength='63'>"
-    "<button class='g'>SAVE & REBOOT</button>"
-    "</form>"
-    "<p class='note'>Saving will write configuration to Flash memory and reboot the device.</p>"
-    "<a href='/' class='gray'>CANCEL</a>"
-    "</div></body></html>",
-    config.deviceId,
-    config.deviceId, config.model, config.location,
-    config.ssid, config.password, config.mqttServer,
-    config.mqttPort, config.mqttTopic);
+  if (!isGet && !isPost) {
+    LOG_INFO("Unsupported HTTP method, closing");
+    sendHttpStatus(client, "405 Method Not Allowed", "Allow: GET, POST\r\n");
+    finishResponse(client);
+    return;
+  }
   
-  if (bodyLen < 0) {
-    bodyLen = 0;
-  } else if (bodyLen >= (int)sizeof(body)) {
-    bodyLen = sizeof(body) - 1;
-    Serial.print("WARNING: Setup page HTML truncated! Buffer size: ");
-    Serial.println(sizeof(body));
+  // Extract the path between the first and second spaces
+  int firstSpace = requestLine.indexOf(' ');
+  int secondSpace = requestLine.indexOf(' ', firstSpace + 1);
+  
+  String path = "/";
+  if (firstSpace > 0 && secondSpace > firstSpace) {
+    path = requestLine.substring(firstSpace + 1, secondSpace);
   }
   
-  Serial.print("Setup page HTML size: ");
-  Serial.println(bodyLen);
+  LOG_DEBUG("Raw path: %s", path.c_str());
   
-  sendHttpHeader(client, bodyLen, "text/html");
-  client.write((const uint8_t*)body, bodyLen);
-  client.flush();
-  Serial.println("Setup page sent!");
-}
-
-void sendSuccessPage(WiFiClient &client) {
-  char body[512];
-  int bodyLen = snprintf(body, sizeof(body),
-    "<!DOCTYPE html><html><head><meta http-equiv='refresh' content='2;url=/'><meta name='viewport' content='width=device-width,initial-scale=1'><title>Saved</title>"
-    "<style>*{box-sizing:border-box}body{font-family:-apple-system,BlinkMacSystemFont,Arial,sans-serif;margin:0;padding:20px;background:#f5f5f7;max-width:500px;margin:0 auto;text-align:center}"
-    ".c{background:#fff;border-radius:12px;padding:30px;box-shadow:0 1px 3px rgba(0,0,0,0.1)}"
-    "h2{color:#34c759;margin:0 0 12px}"
-    "p{color:#666;margin:0}"
-    "</style></head><body>"
-    "<div class='c'><h2>Configuration Saved!</h2>"
-    "<p>Redirecting to home...</p></div></body></html>");
+  // Keep full path for save-config (needs query params)
+  String fullPath = path;
   
-  if (bodyLen < 0) {
-    bodyLen = 0;
-  } else if (bodyLen >= (int)sizeof(body)) {
-    bodyLen = sizeof(body) - 1;
-    Serial.print("WARNING: Success page HTML truncated! Buffer size: ");
-    Serial.println(sizeof(body));
+  // Strip any query string so /control?x=1 becomes /control
+  int qPos = path.indexOf('?');
+  if (qPos > 0) {
+    path = path.substring(0, qPos);
   }
   
-  Serial.print("Success page HTML size: ");
-  Serial.println(bodyLen);
-  
-  sendHttpHeader(client, bodyLen, "text/html");
-  client.write((const uint8_t*)body, bodyLen);
-  client.flush();
-}
-
-// URL decode helper function
-void urlDecode(char* dst, const char* src, int maxLen) {
-  int i = 0, j = 0;
-  while (src[i] && j < maxLen - 1) {
-    if (src[i] == '%' && src[i+1] && src[i+2]) {
-      char hex[3] = {src[i+1], src[i+2], 0};
-      dst[j++] = (char)strtol(hex, NULL, 16);
-      i += 3;
-    } else if (src[i] == '+') {
-      dst[j++] = ' ';
-      i++;
+  LOG_DEBUG("Normalized path: %s", path.c_str());
+  
+  // Parse headers (need Content-Length for POST requests, Upgrade/Sec-WebSocket-Key for /imu)
+  size_t contentLength = 0;
+  bool wsUpgrade = false;
+  char wsKey[32] = {0};
+  String headerLine = "";
+  unsigned long headerStart = millis();
+  while (client.connected() && millis() - headerStart < 100 && (long)(deadline - millis()) > 0) {
+    if (!client.available()) {
+      Thread::wait(1);
+      continue;
+    }
+    char c = client.read();
+    if (c == '\r') continue;
+    if (c == '\n') {
+      if (headerLine.length() == 0) break; // End of headers
+      
+      // Parse Content-Length header
+      if (isPost && headerLine.startsWith("Content-Length:")) {
+        String lengthStr = headerLine.substring(15);
+        lengthStr.trim();
+        contentLength = (size_t)atoi(lengthStr.c_str());
+        LOG_DEBUG("Content-Length: %u", (unsigned)contentLength);
+      }
+      
+      // WebSocket upgrade headers (names are case-insensitive)
+      if (strncasecmp(headerLine.c_str(), "Upgrade:", 8) == 0 && headerLine.indexOf("ebsocket") > 0) {
+        wsUpgrade = true;
+      } else if (strncasecmp(headerLine.c_str(), "Sec-WebSocket-Key:", 18) == 0) {
+        String keyStr = headerLine.substring(18);
+        keyStr.trim();
+        strncpy(wsKey, keyStr.c_str(), sizeof(wsKey) - 1);
+      }
+      
+      headerLine = "";
     } else {
-      dst[j++] = src[i++];
+      headerLine += c;
     }
   }
-  dst[j] = 0;
-}
-
-// Parse query parameter helper
-bool getQueryParam(const String& request, const char* param, char* value, int maxLen) {
-  String searchStr = String(param) + "=";
-  int startIdx = request.indexOf(searchStr);
-  if (startIdx == -1) return false;
   
-  startIdx += searchStr.length();
-  int endIdx = request.indexOf('&', startIdx);
-  if (endIdx == -1) {
-    endIdx = request.indexOf(' ', startIdx);
+  // Route the request; handlers share finishResponse() unless they keep the connection open
+  const char *query = "";
+  if (qPos > 0) {
+    query = fullPath.c_str() + qPos + 1;
   }
-  if (endIdx == -1) return false;
-  
-  String encoded = request.substring(startIdx, endIdx);
-  urlDecode(value, encoded.c_str(), maxLen);
-  return true;
+  HttpRequest req = { client, path.c_str(), query, isPost ? (uint8_t)HTTP_METHOD_POST : (uint8_t)HTTP_METHOD_GET,
+                      wsUpgrade, wsKey, false };
+  dispatchRequest(req);
 }
 
-// WiFi management function with retry logic
-void manageWiFi() {
-  unsigned long now = millis();
-  
-  // Check WiFi status every 5 seconds
-  if (now - lastWifiCheck > WIFI_CHECK_INTERVAL) {
-    lastWifiCheck = now;
+// HTTP worker pool - the acceptor thread hands connections to HTTP_WORKER_COUNT workers through a
+// bounded queue, so one slow or idle browser no longer blocks Home Assistant's switch requests
+void httpWorkerThreadFunc() {
+  while (1) {
+    osEvent evt = httpPendingQueue.get();
+    if (evt.status != osEventMessage) continue;
+    HttpConn *conn = (HttpConn *)evt.value.p;
+    core_util_atomic_decr_u32(&httpQueueDepth, 1);
     
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("WiFi disconnected!");
-      if (displayEnabled) {
-        Screen.print(3, "WiFi lost!");
-      }
-      webServerStarted = false;
-      mqttConnected = false;
-      
-      // Try to reconnect every 30 seconds
-      if (now - lastWifiRetry > WIFI_RETRY_INTERVAL) {
-        lastWifiRetry = now;
-        Serial.println("Attempting WiFi reconnection...");
-        if (displayEnabled) {
-          Screen.print(3, "WiFi retry...");
-        }
-        
-        WiFi.disconnect();
-        delay(1000);
-        WiFi.begin(config.ssid, config.password);
-        
-        // Wait up to 10 seconds for connection
-        int attempts = 0;
-        while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-          delay(500);
-          Serial.print(".");
-          attempts++;
-        }
-        
-        if (WiFi.status() == WL_CONNECTED) {
-          Serial.println("\nWiFi reconnected!");
-          Serial.print("IP: ");
-          Serial.println(WiFi.localIP());
-          if (displayEnabled) {
-            char ipStr[16];
-            sprintf(ipStr, "%d.%d.%d.%d", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
-            Screen.print(3, ipStr);
-          }
-        } else {
-          Serial.println("\nWiFi retry failed!");
-          if (displayEnabled) {
-            Screen.print(3, "WiFi failed!");
-          }
-        }
-      }
+    unsigned long pickedUp = millis();
+    core_util_atomic_incr_u32(&httpStats.queueWaitTotal, pickedUp - conn->acceptedAt);
+    
+    if ((long)(conn->deadline - pickedUp) <= 0) {
+      // Waited in the queue past its deadline - the client has likely given up already
+      core_util_atomic_incr_u32(&httpStats.expired, 1);
+      httpSendUnavailable(conn->client);
     } else {
-      // WiFi is connected
-      if (!webServerStarted) {
-        // Start web server if not already started
-        webServer.begin();
-        webServerStarted = true;
-        Serial.println("Web server restarted");
-        Serial.print("Access control panel at: http://");
-        Serial.println(WiFi.localIP());
-      }
+      core_util_atomic_incr_u32(&httpBusyWorkers, 1);
+      handleHttpClient(conn->client, conn->deadline);
+      core_util_atomic_decr_u32(&httpBusyWorkers, 1);
     }
+    
+    uint32_t latency = millis() - conn->acceptedAt;
+    core_util_atomic_incr_u32(&httpStats.served, 1);
+    core_util_atomic_incr_u32(&httpStats.latencyTotal, latency);
+    histogramObserve(metrics.httpServiceTime, latency);
+    httpStats.latencyLast = latency;
+    if (latency > httpStats.latencyMax) httpStats.latencyMax = latency;  // Racy max is fine for stats
+    
+    conn->client = WiFiClient();
+    httpFreeQueue.put(conn);
   }
 }
 
-// Web server thread function - runs independently
+// Acceptor: services long-lived streams, accepts new clients and queues them for the workers
 void webServerThreadFunc() {
-  Serial.println("Web server thread started");
+  LOG_INFO("Web server thread started");
   
   while (1) {
     if (WiFi.status() == WL_CONNECTED && webServerStarted) {
+      // Push pending telemetry to /events and IMU subscribers before looking for new clients
+      serviceSseClients();
+      serviceImuStream();
+      
       WiFiClient client = webServer.available();
       
       if (client) {
-        Serial.println(">>> Web client connected <<<");
-        
-        // Wait up to 2 seconds for incoming data
-        unsigned long start = millis();
-        while (!client.available() && client.connected() && (millis() - start < 2000)) {
-          Thread::wait(1);
-        }
-        
-        if (!client.available()) {
-          Serial.println("No data received within timeout, closing");
-          client.stop();
-          continue;
-        }
-        
-        // Read the first request line: "GET /path HTTP/1.1"
-        String requestLine = "";
-        unsigned long readStart = millis();
-        while (client.available() && requestLine.length() < 512 && millis() - readStart < 100) {
-          char c = client.read();
-          if (c == '\r') continue;
-          if (c == '\n') break;
-          requestLine += c;
-        }
-        requestLine.trim();
-        
-        Serial.print("HTTP request line: ");
-        Serial.println(requestLine);
-        
-        // Parse HTTP method and path
-        bool isPost = requestLine.startsWith("POST ");
-        bool isGet = requestLine.startsWith("GET ");
-        
-        if (!isGet && !isPost) {
-          Serial.println("Unsupported HTTP method, closing");
-          client.stop();
+        httpStats.accepted++;
+        osEvent evt = httpFreeQueue.get(0);
+        if (evt.status != osEventMessage) {
+          // Every worker busy and the queue full - shed load instead of stalling the acceptor
+          httpStats.shed++;
+          LOG_INFO("HTTP worker pool saturated, rejecting client");
+          httpSendUnavailable(client);
           continue;
         }
         
-        // Extract the path between the first and second spaces
-        int firstSpace = requestLine.indexOf(' ');
-        int secondSpace = requestLine.indexOf(' ', firstSpace + 1);
-        
-        String path = "/";
-        if (firstSpace > 0 && secondSpace > firstSpace) {
-          path = requestLine.substring(firstSpace + 1, secondSpace);
-        }
-        
-        Serial.print("Raw path: ");
-        Serial.println(path);
-        
-        // Keep full path for save-config (needs query params)
-        String fullPath = path;
-        
-        // Strip any query string so /control?x=1 becomes /control
-        int qPos = path.indexOf('?');
-        if (qPos > 0) {
-          path = path.substring(0, qPos);
-        }
-        
-        Serial.print("Normalized path: ");
-        Serial.println(path);
-        
-        // Parse headers (need Content-Length for POST requests)
-        size_t contentLength = 0;
-        String headerLine = "";
-        unsigned long headerStart = millis();
-        while (client.connected() && millis() - headerStart < 100) {
-          if (!client.available()) {
-            Thread::wait(1);
-            continue;
-          }
-          char c = client.read();
-          if (c == '\r') continue;
-          if (c == '\n') {
-            if (headerLine.length() == 0) break; // End of headers
-            
-            // Parse Content-Length header
-            if (isPost && headerLine.startsWith("Content-Length:")) {
-              String lengthStr = headerLine.substring(15);
-              lengthStr.trim();
-              contentLength = (size_t)atoi(lengthStr.c_str());
-              Serial.print("Content-Length: ");
-              Serial.println(contentLength);
-            }
-            
-            headerLine = "";
-          } else {
-            headerLine += c;
-          }
-        }
-        
-        // Process commands
-        if (path.length() > 0) {
-          unsigned long now = millis();
-          
-          // Route: Main page
-          if (path == "/") {
-            Serial.println("Serving main page");
-            sendMainPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          
-          // Route: Control page
-          else if (path == "/control") {
-            Serial.println("Serving control page");
-            sendControlPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          
-          // Route: Telemetry page
-          else if (path == "/telemetry") {
-            Serial.println("Serving telemetry page");
-            sendTelemetryPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          
-          // Route: Setup page
-          else if (path == "/setup") {
-            Serial.println("Serving setup page");
-            sendSetupPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          
-          // Route: Save configuration
-          else if (path == "/save-config") {
-            Serial.println("Saving configuration from web form...");
-            
-            // Parse all parameters from fullPath
-            char tempBuffer[64];
-            
-            if (getQueryParam(fullPath, "deviceId", tempBuffer, sizeof(tempBuffer))) {
-              strncpy(config.deviceId, tempBuffer, sizeof(config.deviceId) - 1);
-              config.deviceId[sizeof(config.deviceId) - 1] = 0;
-            }
-            if (getQueryParam(fullPath, "model", tempBuffer, sizeof(tempBuffer))) {
-              strncpy(config.model, tempBuffer, sizeof(config.model) - 1);
-              config.model[sizeof(config.model) - 1] = 0;
-            }
-            if (getQueryParam(fullPath, "location", tempBuffer, sizeof(tempBuffer))) {
-              strncpy(config.location, tempBuffer, sizeof(config.location) - 1);
-              config.location[sizeof(config.location) - 1] = 0;
-            }
-            if (getQueryParam(fullPath, "ssid", tempBuffer, sizeof(tempBuffer))) {
-              strncpy(config.ssid, tempBuffer, sizeof(config.ssid) - 1);
-              config.ssid[sizeof(config.ssid) - 1] = 0;
-            }
-            if (getQueryParam(fullPath, "password", tempBuffer, sizeof(tempBuffer))) {
-              strncpy(config.password, tempBuffer, sizeof(config.password) - 1);
-              config.password[sizeof(config.password) - 1] = 0;
-            }
-            if (getQueryParam(fullPath, "mqttServer", tempBuffer, sizeof(tempBuffer))) {
-              strncpy(config.mqttServer, tempBuffer, sizeof(config.mqttServer) - 1);
-              config.mqttServer[sizeof(config.mqttServer) - 1] = 0;
-            }
-            if (getQueryParam(fullPath, "mqttPort", tempBuffer, sizeof(tempBuffer))) {
-              int port = atoi(tempBuffer);
-              if (port > 0 && port <= 65535) {
-                config.mqttPort = port;
-              }
-            }
-            if (getQueryParam(fullPath, "mqttTopic", tempBuffer, sizeof(tempBuffer))) {
-              strncpy(config.mqttTopic, tempBuffer, sizeof(config.mqttTopic) - 1);
-              config.mqttTopic[sizeof(config.mqttTopic) - 1] = 0;
-            }
-            
-            // Save to Flash
-            Serial.println("Writing configuration to Flash...");
-            if (saveConfigToFlash()) {
-              Serial.println("Configuration saved successfully!");
-              sendSuccessPage(client);
-              client.flush();
-              Thread::wait(10);
-              client.stop();
-            } else {
-              Serial.println("Failed to save configuration!");
-              sendMainPage(client);
-              client.flush();
-              Thread::wait(10);
-              client.stop();
-            }
-            continue;
-          }
-          
-          // Control commands with debouncing
-          else if (path == "/led" && now - lastLedChange > DEBOUNCE_DELAY) {
-            // Check query parameter for state
-            if (fullPath.indexOf("state=on") > 0) {
-              ledEnabled = true;
-              lastLedChange = now;
-            } else if (fullPath.indexOf("state=off") > 0) {
-              ledEnabled = false;
-              rgbLED.turnOff();
-              lastLedChange = now;
-            }
-            sendControlPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          else if (path == "/display" && now - lastDisplayChange > DEBOUNCE_DELAY) {
-            // Check query parameter for state
-            if (fullPath.indexOf("state=on") > 0) {
-              displayEnabled = true;
-              lastDisplayChange = now;
-              Screen.init();
-              Screen.print(0, config.deviceId);
-              Screen.print(1, "Web Control");
-              if (WiFi.status() == WL_CONNECTED) {
-                char ipStr[16];
-                sprintf(ipStr, "%d.%d.%d.%d", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
-                Screen.print(3, ipStr);
-              }
-            } else if (fullPath.indexOf("state=off") > 0) {
-              displayEnabled = false;
-              lastDisplayChange = now;
-              Screen.clean();
-            }
-            sendControlPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          else if (path == "/wifiled") {
-            if (fullPath.indexOf("state=on") > 0) {
-              wifiLedEnabled = true;
-              pinMode(LED_WIFI, OUTPUT);
-              digitalWrite(LED_WIFI, HIGH);
-              Serial.println("WiFi LED turned ON");
-            } else if (fullPath.indexOf("state=off") > 0) {
-              wifiLedEnabled = false;
-              pinMode(LED_WIFI, OUTPUT);
-              digitalWrite(LED_WIFI, LOW);
-              Serial.println("WiFi LED turned OFF");
-            }
-            sendControlPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          else if (path == "/azureled") {
-            if (fullPath.indexOf("state=on") > 0) {
-              azureLedEnabled = true;
-              pinMode(LED_AZURE, OUTPUT);
-              digitalWrite(LED_AZURE, HIGH);
-              Serial.println("Azure LED turned ON");
-            } else if (fullPath.indexOf("state=off") > 0) {
-              azureLedEnabled = false;
-              pinMode(LED_AZURE, OUTPUT);
-              digitalWrite(LED_AZURE, LOW);
-              Serial.println("Azure LED turned OFF");
-            }
-            sendControlPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          else if (path == "/userled") {
-            if (fullPath.indexOf("state=on") > 0) {
-              userLedEnabled = true;
-              pinMode(LED_USER, OUTPUT);
-              digitalWrite(LED_USER, HIGH);
-              Serial.println("User LED turned ON");
-            } else if (fullPath.indexOf("state=off") > 0) {
-              userLedEnabled = false;
-              pinMode(LED_USER, OUTPUT);
-              digitalWrite(LED_USER, LOW);
-              Serial.println("User LED turned OFF");
-            }
-            sendControlPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          else if (path == "/reset") {
-            Serial.println("RESET requested via web interface");
-            sendControlPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Thread::wait(100);
-            NVIC_SystemReset();
-          }
-          else if (path == "/watchdog") {
-            if (fullPath.indexOf("state=enable") > 0) {
-              watchdogEnabled = true;
-              lastSuccessfulNetworkActivity = millis(); // Reset timer when enabling
-              Serial.println("Watchdog ENABLED via web interface");
-            } else if (fullPath.indexOf("state=disable") > 0) {
-              watchdogEnabled = false;
-              Serial.println("Watchdog DISABLED via web interface");
-            }
-            sendControlPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-          
-          // Unknown path - serve main page
-          else {
-            Serial.print("Unknown path: ");
-            Serial.println(path);
-            Serial.println("Serving main page");
-            sendMainPage(client);
-            client.flush();
-            Thread::wait(10);
-            client.stop();
-            Serial.println("Client connection closed");
-            continue;
-          }
-        }
-        
-        // If we get here with no path, serve main page
-        Serial.println("No path specified, serving main page");
-        sendMainPage(client);
-        client.flush();
-        Thread::wait(10);
-        client.stop();
-        Serial.println("Client connection closed");
+        HttpConn *conn = (HttpConn *)evt.value.p;
+        conn->client = client;
+        conn->acceptedAt = millis();
+        conn->deadline = conn->acceptedAt + HTTP_CONN_DEADLINE;
+        uint32_t depth = core_util_atomic_incr_u32(&httpQueueDepth, 1);
+        if (depth > httpStats.queueDepthMax) httpStats.queueDepthMax = depth;
+        httpPendingQueue.put(conn);
+        continue;  // Check for another client right away
       }
     }
     
@@ -1531,10 +4081,35 @@ void webServerThreadFunc() {
   }
 }
 
+// Create the worker threads and fill the free-slot queue
+void startHttpWorkers() {
+  for (int i = 0; i < HTTP_QUEUE_SLOTS; i++) {
+    httpFreeQueue.put(&httpConns[i]);
+  }
+  for (int i = 0; i < HTTP_WORKER_COUNT; i++) {
+    httpWorkerThreads[i] = new rtos::Thread(osPriorityNormal, HTTP_WORKER_STACK_SIZE);
+    if (httpWorkerThreads[i] == NULL) {
+      LOG_ERROR("Failed to create HTTP worker thread!");
+    } else {
+      httpWorkerThreads[i]->start(callback(httpWorkerThreadFunc));
+    }
+  }
+}
+
 // Arduino setup function - called once at startup
 void setup() {
   // Initialize hardware
   Serial.begin(115200);
+  
+  // Start the log drain first so every LOG_* call from here on reaches the console
+  logInit();
+  logThread_ptr = new rtos::Thread(osPriorityLow, LOG_THREAD_STACK_SIZE);
+  if (logThread_ptr != NULL) {
+    logThread_ptr->start(callback(logThreadFunc));
+  }
+#if ENABLE_PROFILING
+  profileInit();
+#endif
   delay(2000);
   
   Serial.println("\n\n\n");
@@ -1557,6 +4132,15 @@ void setup() {
     configureDevice();
   }
   
+  // Ship log lines to the remote collector once the config says where
+  logRemoteSink = syslogSink;
+  
+  // Locate the end of the sensor history in flash
+  historyInit();
+  
+  // Apply runtime settings saved over HTTP/MQTT
+  settingsInit();
+  
   // Show current configuration
   Serial.println("\n=== CURRENT CONFIGURATION ===");
   Serial.print("Device ID: "); Serial.println(config.deviceId);
@@ -1564,6 +4148,8 @@ void setup() {
   Serial.print("MQTT Server: "); Serial.println(config.mqttServer);
   Serial.print("MQTT Port: "); Serial.println(config.mqttPort);
   Serial.print("MQTT Topic: "); Serial.println(config.mqttTopic);
+  Serial.print("Syslog: "); Serial.print(config.syslogHost[0] ? config.syslogHost : "off");
+  Serial.print(":"); Serial.println(config.syslogPort);
   Serial.println();
   
   // Aggressively disable any Azure background services
@@ -1629,8 +4215,12 @@ void setup() {
     webServer.begin();
     webServerStarted = true;
     
-    // Create web server thread using mbed Thread with 8KB stack
-    webServerThread_ptr = new rtos::Thread(osPriorityNormal, 8192);
+    // Request handling runs on the worker pool; the acceptor thread only queues connections
+    // and services /events and /imu streams
+    startHttpWorkers();
+    
+    // Create web server (acceptor) thread using mbed Thread
+    webServerThread_ptr = new rtos::Thread(osPriorityNormal, 4096);
     if (webServerThread_ptr == NULL) {
       Serial.println("Failed to create web server thread!");
     } else {
@@ -1638,6 +4228,14 @@ void setup() {
       Serial.println("Web server thread created and started");
     }
     
+    // IMU sampler for the /imu WebSocket stream (idle until a client connects)
+    imuThread_ptr = new rtos::Thread(osPriorityAboveNormal, 2048);
+    if (imuThread_ptr == NULL) {
+      Serial.println("Failed to create IMU sampler thread!");
+    } else {
+      imuThread_ptr->start(callback(imuThreadFunc));
+    }
+    
     Serial.println("=== WEB SERVER STARTED ===");
     Serial.print("Listening on: ");
     Serial.print(WiFi.localIP());
@@ -1666,86 +4264,115 @@ void loop() {
   static unsigned long lastMqttPublish = 0;  // Separate timer for MQTT
   
   unsigned long now = millis();
+  RuntimeSettings settings;
+  settingsRead(settings);  // One consistent snapshot per pass
   
   // Keep front-panel LEDs in their current state (only force off if not manually enabled)
   if (!wifiLedEnabled) digitalWrite(LED_WIFI,  LOW);
   if (!azureLedEnabled) digitalWrite(LED_AZURE, LOW);
   if (!userLedEnabled) digitalWrite(LED_USER,  LOW);
   
+#if ENABLE_PROFILING
+  serviceSerialCommands();
+#endif
+  
   // Check network watchdog (monitors connectivity and reboots if needed)
   checkNetworkWatchdog();
   
   // Manage WiFi connection with retry logic
   manageWiFi();
   
+  // Write runtime settings changed with persist=1 once they have settled
+  settingsService(now);
+  
   // Try to connect MQTT if not connected (non-blocking retry)
     static unsigned long lastMqttAttempt = 0;
     if (!mqttConnected && WiFi.status() == WL_CONNECTED && (now - lastMqttAttempt > 10000)) {
       lastMqttAttempt = now;
-      Serial.println("Attempting MQTT connection...");
-      Serial.print("Device IP: ");
-      Serial.println(WiFi.localIP());
-      Serial.print("Gateway: ");
-      Serial.println(WiFi.gatewayIP());
+      LOG_INFO("Attempting MQTT connection...");
+      LOG_DEBUG("Device IP: %d.%d.%d.%d", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
+      LOG_DEBUG("Gateway: %d.%d.%d.%d", WiFi.gatewayIP()[0], WiFi.gatewayIP()[1], WiFi.gatewayIP()[2], WiFi.gatewayIP()[3]);
       if (displayEnabled) {
         Screen.print(2, "MQTT connecting...");
       }
       mqttConnected = connectMQTT();
       if (mqttConnected) {
+        metrics.mqttConnects++;
         if (displayEnabled) {
           Screen.print(2, "MQTT connected!");
         }
-        Serial.println("MQTT connected successfully!");
+        LOG_INFO("MQTT connected successfully!");
       } else {
         if (displayEnabled) {
           Screen.print(2, "MQTT failed!");
         }
-        Serial.println("MQTT connection failed, will retry in 10 seconds");
+        metrics.mqttConnectFailures++;
+        LOG_WARN("MQTT connection failed, will retry in 10 seconds");
       }
     }
 
-    // Read sensors every 30 seconds
-    if (now - lastSensorRead > 30000) {
+    // Pick up actuator commands sent to "<topic>/set"
+    if (mqttConnected) {
+      serviceMqttIncoming();
+    }
+
+    // Read sensors every sample_interval seconds (30 by default)
+    if (now - lastSensorRead > settings.sampleInterval * 1000UL) {
       lastSensorRead = now;
       
-      Serial.print("\n=== Sensor Reading #");
-      Serial.print(counter);
-      Serial.println(" ===");
+      LOG_INFO("=== Sensor Reading #%d ===", counter);
       
       // Read Temperature and Humidity
+      // (each read holds sensorBusMutex - the IMU sampler shares the bus while /imu is streaming;
+      //  read times are taken inside the lock so they exclude waiting for the sampler)
+      unsigned long readStart;
       float temperature, humidity;
+      sensorBusMutex.lock();
+      readStart = micros();
+      PROFILE_START(PROF_HTS221_TEMPERATURE);
       ht_sensor->getTemperature(&temperature);
+      PROFILE_STOP(PROF_HTS221_TEMPERATURE);
+      PROFILE_START(PROF_HTS221_HUMIDITY);
       ht_sensor->getHumidity(&humidity);
+      PROFILE_STOP(PROF_HTS221_HUMIDITY);
+      histogramObserve(metrics.sensorReadTime[SENSOR_HTS221], micros() - readStart);
+      sensorBusMutex.unlock();
       
       // Apply temperature calibration offset
-      temperature += TEMPERATURE_OFFSET;
+      temperature += settings.temperatureOffset;
       
       // Store in global variables for web display
       lastTemperature = temperature;
       lastHumidity = humidity;
       
-      Serial.print("Temperature: ");
-      Serial.print(temperature);
-      Serial.println(" °C");
+      LOG_INFO("Temperature: %.2f °C", temperature);
       
-      Serial.print("Humidity: ");
-      Serial.print(humidity);
-      Serial.println(" %");
+      LOG_INFO("Humidity: %.2f %%", humidity);
       
       // Read Pressure
       float pressure;
+      sensorBusMutex.lock();
+      readStart = micros();
+      PROFILE_START(PROF_LPS22HB_PRESSURE);
       pressure_sensor->getPressure(&pressure);
+      PROFILE_STOP(PROF_LPS22HB_PRESSURE);
+      histogramObserve(metrics.sensorReadTime[SENSOR_LPS22HB], micros() - readStart);
+      sensorBusMutex.unlock();
       // Apply calibration offset to match actual atmospheric pressure
-      pressure += PRESSURE_OFFSET;
+      pressure += settings.pressureOffset;
       lastPressure = pressure;
       
-      Serial.print("Pressure: ");
-      Serial.print(pressure);
-      Serial.println(" mbar");
+      LOG_INFO("Pressure: %.2f mbar", pressure);
       
       // Read Accelerometer
       int axes[3];
+      sensorBusMutex.lock();
+      readStart = micros();
+      PROFILE_START(PROF_LSM6DSL_ACCEL);
       acc_gyro->getXAxes(axes);
+      PROFILE_STOP(PROF_LSM6DSL_ACCEL);
+      histogramObserve(metrics.sensorReadTime[SENSOR_LSM6DSL], micros() - readStart);
+      sensorBusMutex.unlock();
       float accel_x = axes[0] / 1000.0f;  // Convert to g
       float accel_y = axes[1] / 1000.0f;
       float accel_z = axes[2] / 1000.0f;
@@ -1753,17 +4380,17 @@ void loop() {
       lastAccelY = accel_y;
       lastAccelZ = accel_z;
       
-      Serial.print("Accelerometer: X=");
-      Serial.print(accel_x, 3);
-      Serial.print("g Y=");
-      Serial.print(accel_y, 3);
-      Serial.print("g Z=");
-      Serial.print(accel_z, 3);
-      Serial.println("g");
+      LOG_INFO("Accelerometer: X=%.3fg Y=%.3fg Z=%.3fg", accel_x, accel_y, accel_z);
       
       // Read Gyroscope
       int gyro_axes[3];
+      sensorBusMutex.lock();
+      readStart = micros();
+      PROFILE_START(PROF_LSM6DSL_GYRO);
       acc_gyro->getGAxes(gyro_axes);
+      PROFILE_STOP(PROF_LSM6DSL_GYRO);
+      histogramObserve(metrics.sensorReadTime[SENSOR_LSM6DSL], micros() - readStart);
+      sensorBusMutex.unlock();
       float gyro_x = gyro_axes[0] / 1000.0f;  // Convert to dps
       float gyro_y = gyro_axes[1] / 1000.0f;
       float gyro_z = gyro_axes[2] / 1000.0f;
@@ -1771,17 +4398,17 @@ void loop() {
       lastGyroY = gyro_y;
       lastGyroZ = gyro_z;
       
-      Serial.print("Gyroscope: X=");
-      Serial.print(gyro_x, 2);
-      Serial.print("dps Y=");
-      Serial.print(gyro_y, 2);
-      Serial.print("dps Z=");
-      Serial.print(gyro_z, 2);
-      Serial.println("dps");
+      LOG_INFO("Gyroscope: X=%.2fdps Y=%.2fdps Z=%.2fdps", gyro_x, gyro_y, gyro_z);
       
       // Read Magnetometer
       int mag_axes[3];
+      sensorBusMutex.lock();
+      readStart = micros();
+      PROFILE_START(PROF_LIS2MDL_MAG);
       magnetometer->getMAxes(mag_axes);
+      PROFILE_STOP(PROF_LIS2MDL_MAG);
+      histogramObserve(metrics.sensorReadTime[SENSOR_LIS2MDL], micros() - readStart);
+      sensorBusMutex.unlock();
       float mag_x = mag_axes[0] / 1000.0f;  // Convert to gauss
       float mag_y = mag_axes[1] / 1000.0f;
       float mag_z = mag_axes[2] / 1000.0f;
@@ -1789,16 +4416,11 @@ void loop() {
       lastMagY = mag_y;
       lastMagZ = mag_z;
       
-      Serial.print("Magnetometer: X=");
-      Serial.print(mag_x, 3);
-      Serial.print("G Y=");
-      Serial.print(mag_y, 3);
-      Serial.print("G Z=");
-      Serial.print(mag_z, 3);
-      Serial.println("G");
+      LOG_INFO("Magnetometer: X=%.3fG Y=%.3fG Z=%.3fG", mag_x, mag_y, mag_z);
       
       // Update display (only if enabled)
       if (displayEnabled) {
+        PROFILE_SPAN(PROF_SCREEN_UPDATE);
         char tempStr[32];
         sprintf(tempStr, "T:%.1fC H:%.0f%%", temperature, humidity);
         Screen.print(1, tempStr);
@@ -1817,11 +4439,15 @@ void loop() {
         }
       }
       
+      // Keep the sample in the on-flash history
+      historyAppend(temperature, humidity, pressure);
+      
       counter++;
+      telemetrySeq++;  // Publish the new sample to /events subscribers
     }
     
-    // Publish to MQTT every 30 seconds (separate from sensor reading)
-    if (mqttConnected && now - lastMqttPublish > 30000) {
+    // Publish to MQTT every publish_interval seconds (separate from sensor reading)
+    if (mqttConnected && now - lastMqttPublish > settings.publishInterval * 1000UL) {
       lastMqttPublish = now;
       
       // Create JSON payload with latest sensor values
@@ -1836,15 +4462,14 @@ void loop() {
         lastGyroX, lastGyroY, lastGyroZ,
         lastMagX, lastMagY, lastMagZ);
       
-      Serial.print("MQTT JSON: ");
-      Serial.println(jsonPayload);
+      LOG_DEBUG("MQTT JSON: %s", jsonPayload);
       
       if (publishMQTT(config.mqttTopic, jsonPayload)) {
-        Serial.println("MQTT published successfully");
+        LOG_DEBUG("MQTT published successfully");
         // Update watchdog - successful network activity
         lastSuccessfulNetworkActivity = millis();
       } else {
-        Serial.println("MQTT publish failed, will retry");
+        LOG_WARN("MQTT publish failed, will retry");
         if (displayEnabled) {
           Screen.print(3, "MQTT failed!");
         }
@@ -1865,5 +4490,7 @@ void loop() {
     }
   }
   
+  histogramObserve(metrics.loopTime, millis() - now);
+  
   delay(50);   // Reasonable delay for stable operation
 }